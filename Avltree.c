@@ -2,12 +2,20 @@
 
 #include<stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include "workpool.h"
 // Structure for a tree node
 struct TreeNode {
     int data;
     struct TreeNode* left;
     struct TreeNode* right;
     int height; // Height of the node
+    int rthread; // 1 when right is a thread to the in-order successor instead of a child
+    int high; // End of the interval [data, high]; equal to data for plain keys
+    int maxHigh; // Largest high in this subtree
+    int count; // Copies of the key held by this node; see avl_minsert
 };
 // Function to get the height of a node
 int height(struct TreeNode* node) {
@@ -27,76 +35,135 @@ struct TreeNode* newNode = (struct TreeNode*)malloc(sizeof(struct TreeNode));
 	newNode->left = NULL;
 	newNode->right = NULL;
 	newNode->height = 1; // New node is initially at height 1
+	newNode->rthread = 0;
+	newNode->high = key;
+	newNode->maxHigh = key;
+	newNode->count = 1;
     }
     return newNode;
 }
+// Function to get the right child of a node (NULL when right is only a thread)
+struct TreeNode* rightChild(struct TreeNode* node) {
+    return node->rthread ? NULL : node->right;
+}
+// Function to set the right subtree of a node; in a threaded tree an empty
+// right subtree becomes a thread to succ, the node's in-order successor
+void setRight(struct TreeNode* node, struct TreeNode* child, struct TreeNode* succ, int threaded) {
+    if (child == NULL && threaded) {
+	node->right = succ;
+	node->rthread = 1;
+    } else {
+	node->right = child;
+	node->rthread = 0;
+    }
+}
+// Function to recompute the largest interval end of a subtree from its children
+void updateMaxHigh(struct TreeNode* node) {
+    node->maxHigh = node->high;
+    if (node->left != NULL && node->left->maxHigh > node->maxHigh)
+	node->maxHigh = node->left->maxHigh;
+    if (rightChild(node) != NULL && node->right->maxHigh > node->maxHigh)
+	node->maxHigh = node->right->maxHigh;
+}
+// Function to compare (key, high) with a node; intervals order by start, then by end
+int compareKey(int key, int high, struct TreeNode* node) {
+    if (key != node->data)
+	return key < node->data ? -1 : 1;
+    if (high != node->high)
+	return high < node->high ? -1 : 1;
+    return 0;
+}
 // Function to right rotate subtree rooted with y
 struct TreeNode* rightRotate(struct TreeNode* y) {
     struct TreeNode* x = y->left;
-    struct TreeNode* T2 = x->right;
-    // Perform rotation
+    struct TreeNode* T2 = rightChild(x);
+    // Perform rotation (if x had a thread it pointed to y, which is now its child)
     x->right = y;
+    x->rthread = 0;
     y->left = T2;
     // Update heights
-    y->height = maxm(height(y->left), height(y->right)) + 1;
-    x->height = maxm(height(x->left), height(x->right)) + 1;
+    y->height = maxm(height(y->left), height(rightChild(y))) + 1;
+    x->height = maxm(height(x->left), height(rightChild(x))) + 1;
+    // Update interval augmentation, child first
+    updateMaxHigh(y);
+    updateMaxHigh(x);
     // Return new root
     return x;
 }
-// Function to left rotate subtree rooted with x
-struct TreeNode* leftRotate(struct TreeNode* x) {
+// Function to left rotate subtree rooted with x; in a threaded tree x keeps a thread to y
+struct TreeNode* leftRotateMode(struct TreeNode* x, int threaded) {
     struct TreeNode* y = x->right;
     struct TreeNode* T2 = y->left;
     // Perform rotation
     y->left = x;
-    x->right = T2;
+    setRight(x, T2, y, threaded);
     // Update heights
-    x->height = maxm(height(x->left), height(x->right)) + 1;
-    y->height = maxm(height(y->left), height(y->right)) + 1;
+    x->height = maxm(height(x->left), height(rightChild(x))) + 1;
+    y->height = maxm(height(y->left), height(rightChild(y))) + 1;
+    // Update interval augmentation, child first
+    updateMaxHigh(x);
+    updateMaxHigh(y);
     // Return new root
     return y;
 }
+// Function to left rotate subtree rooted with x
+struct TreeNode* leftRotate(struct TreeNode* x) {
+    return leftRotateMode(x, 0);
+}
 // Function to get the balance factor of a node
 int getBalance(struct TreeNode* node) {
     if (node == NULL)
 	return 0;
-    return height(node->left) - height(node->right);
+    return height(node->left) - height(rightChild(node));
 }
-// Function to insert a key into the AVL tree
-struct TreeNode* insert(struct TreeNode* root, int key) {
+// Function to insert the key (key, high) into the subtree; succ is the in-order successor
+// of the subtree's largest key and is only used to thread new nodes when threaded is set
+struct TreeNode* insertNode(struct TreeNode* root, int key, int high, struct TreeNode* succ, int threaded) {
     // Perform standard BST insert
-    int balance;
-    if (root == NULL)
-	return createNode(key);
-    if (key < root->data)
-	root->left = insert(root->left, key);
-    else if (key > root->data)
-	root->right = insert(root->right, key);
+    int balance, cmp;
+    if (root == NULL) {
+	root = createNode(key);
+	if (root != NULL) {
+	    root->high = root->maxHigh = high;
+	    setRight(root, NULL, succ, threaded);
+	}
+	return root;
+    }
+    cmp = compareKey(key, high, root);
+    if (cmp < 0)
+	root->left = insertNode(root->left, key, high, root, threaded);
+    else if (cmp > 0)
+	setRight(root, insertNode(rightChild(root), key, high, succ, threaded), succ, threaded);
     else // Duplicate keys not allowed
 	return root;
     // Update height of the current node
-    root->height = 1 + maxm(height(root->left), height(root->right));
+    root->height = 1 + maxm(height(root->left), height(rightChild(root)));
+    updateMaxHigh(root);
     // Get the balance factor to check whether this node became unbalanced
      balance = getBalance(root);
     // Left Left Case
-    if (balance > 1 && key < root->left->data)
+    if (balance > 1 && compareKey(key, high, root->left) < 0)
         return rightRotate(root);
     // Right Right Case
-    if (balance < -1 && key > root->right->data)
-        return leftRotate(root);
+    if (balance < -1 && compareKey(key, high, root->right) > 0)
+        return leftRotateMode(root, threaded);
     // Left Right Case
-    if (balance > 1 && key > root->left->data) {
-        root->left = leftRotate(root->left);
+    if (balance > 1 && compareKey(key, high, root->left) > 0) {
+        root->left = leftRotateMode(root->left, threaded);
         return rightRotate(root);
     }
     // Right Left Case
-    if (balance < -1 && key < root->right->data) {
+    if (balance < -1 && compareKey(key, high, root->right) < 0) {
         root->right = rightRotate(root->right);
-        return leftRotate(root);
+        return leftRotateMode(root, threaded);
     }
     // Return the unchanged node pointer
     return root;
 }
+// Function to insert a key into the AVL tree
+struct TreeNode* insert(struct TreeNode* root, int key) {
+    return insertNode(root, key, key, NULL, 0);
+}
 // Function to find the node with the minimum value
 struct TreeNode* minValueNode(struct TreeNode* node) {
     struct TreeNode* current = node;
@@ -104,41 +171,64 @@ struct TreeNode* minValueNode(struct TreeNode* node) {
         current = current->left;
     return current;
 }
-// Function to delete a key from the AVL tree
-struct TreeNode* deleteNode(struct TreeNode* root, int key) {
-    int balance;
+// Function to find the node with the maximum value
+struct TreeNode* maxValueNode(struct TreeNode* node) {
+    struct TreeNode* current = node;
+    while (rightChild(current) != NULL)
+        current = current->right;
+    return current;
+}
+// Function to delete the key (key, high) from the subtree (succ and threaded as for insertNode)
+struct TreeNode* removeNode(struct TreeNode* root, int key, int high, struct TreeNode* succ, int threaded) {
+    int balance, cmp;
     if (root == NULL)
 	return root;
     // Perform standard BST delete
-    if (key < root->data)
-	root->left = deleteNode(root->left, key);
-    else if (key > root->data)
-	root->right = deleteNode(root->right, key);
-    else {
+    cmp = compareKey(key, high, root);
+    if (cmp < 0)
+	root->left = removeNode(root->left, key, high, root, threaded);
+    else if (cmp > 0) {
+	if (rightChild(root) == NULL) // Key not present
+	    return root;
+	setRight(root, removeNode(root->right, key, high, succ, threaded), succ, threaded);
+    } else {
 	// Node with only one child or no child
-	if ((root->left == NULL) || (root->right == NULL)) {
-	    struct TreeNode* temp = root->left ? root->left : root->right;
+	if ((root->left == NULL) || (rightChild(root) == NULL)) {
+	    struct TreeNode* temp = root->left ? root->left : rightChild(root);
 	    // No child case
 	    if (temp == NULL) {
 		temp = root;
 		root = NULL;
-	    } else // One child case
+	    } else if (!threaded) // One child case
 		*root = *temp; // Copy the contents of the non-empty child
+	    else {
+		// Threads hold node addresses, so a copy would leave them dangling:
+		// link the child in place instead, and re-aim the predecessor's
+		// thread from the removed node to its successor
+		if (temp == root->left)
+		    maxValueNode(temp)->right = succ;
+		struct TreeNode* child = temp;
+		temp = root;
+		root = child;
+	    }
 	    free(temp);
 	} else {
 	    // Node with two children, get the inorder successor
 	    struct TreeNode* temp = minValueNode(root->right);
 	    // Copy the inorder successor's data to this node
 	    root->data = temp->data;
+	    root->high = temp->high;
+	    root->count = temp->count;
 	    // Delete the inorder successor
-	    root->right = deleteNode(root->right, temp->data);
+	    setRight(root, removeNode(root->right, temp->data, temp->high, succ, threaded), succ, threaded);
 	}
     }
     // If the tree had only one node, then return
     if (root == NULL)
 	return root;
     // Update height of the current node
-    root->height = 1 + maxm(height(root->left), height(root->right));
+    root->height = 1 + maxm(height(root->left), height(rightChild(root)));
+    updateMaxHigh(root);
     // Get the balance factor to check whether this node became unbalanced
     balance = getBalance(root);
     // Left Left Case
@@ -146,41 +236,586 @@ struct TreeNode* deleteNode(struct TreeNode* root, int key) {
         return rightRotate(root);
     // Left Right Case
     if (balance > 1 && getBalance(root->left) < 0) {
-        root->left = leftRotate(root->left);
+        root->left = leftRotateMode(root->left, threaded);
         return rightRotate(root);
     }
     // Right Right Case
     if (balance < -1 && getBalance(root->right) <= 0)
-        return leftRotate(root);
+        return leftRotateMode(root, threaded);
     // Right Left Case
     if (balance < -1 && getBalance(root->right) > 0) {
         root->right = rightRotate(root->right);
-        return leftRotate(root);
+        return leftRotateMode(root, threaded);
     }
     return root;
 }
+// Function to delete a key from the AVL tree
+struct TreeNode* deleteNode(struct TreeNode* root, int key) {
+    return removeNode(root, key, key, NULL, 0);
+}
 // Function to perform in-order traversal of the AVL tree
 void inOrderTraversal(struct TreeNode* root) {
     if (root != NULL) {
         inOrderTraversal(root->left);
         printf("%d ", root->data);
-        inOrderTraversal(root->right);
+        inOrderTraversal(rightChild(root));
     }
 }
 // Function to free the memory allocated for the AVL tree
+void freeAVLTree(struct TreeNode* root) {
+    if (root != NULL) {
+        freeAVLTree(root->left);
+        freeAVLTree(rightChild(root));
+        free(root);
+    }
+}
+
+// ---------- Join/split based bulk set operations ----------
+// join(l, k, r) builds one balanced tree out of l, k and r (all keys of l < k < all keys of r)
+// in O(|height(l) - height(r)|). split and the set operations are built on top of it, so a
+// union of an m-key delta into an n-key tree costs O(m log(n/m + 1)) instead of m inserts.
+// The set operations consume both input trees and reuse their nodes. They work on
+// unthreaded trees of plain keys; use avl_unthread first on a threaded one.
+
+#define AVL_UNION 0
+#define AVL_INTERSECT 1
+#define AVL_DIFFERENCE 2
+#define AVL_PAR_HEIGHT 10 // fork only when both subtrees are at least this tall
+
+// Function to recompute the height of a node from its children
+void updateHeight(struct TreeNode* node) {
+    node->height = 1 + maxm(height(node->left), height(node->right));
+    updateMaxHigh(node);
+}
+// Function to join when l is taller: walk down the right spine of l to a subtree of r's height
+struct TreeNode* joinRight(struct TreeNode* l, struct TreeNode* mid, struct TreeNode* r) {
+    if (height(l->right) <= height(r) + 1) {
+        mid->left = l->right;
+        mid->right = r;
+        updateHeight(mid);
+        if (height(mid) <= height(l->left) + 1) {
+            l->right = mid;
+            updateHeight(l);
+            return l;
+        }
+        l->right = rightRotate(mid);
+        updateHeight(l);
+        return leftRotate(l);
+    }
+    l->right = joinRight(l->right, mid, r);
+    updateHeight(l);
+    if (height(l->right) > height(l->left) + 1)
+        return leftRotate(l);
+    return l;
+}
+// Function to join when r is taller: mirror image of joinRight
+struct TreeNode* joinLeft(struct TreeNode* l, struct TreeNode* mid, struct TreeNode* r) {
+    if (height(r->left) <= height(l) + 1) {
+        mid->left = l;
+        mid->right = r->left;
+        updateHeight(mid);
+        if (height(mid) <= height(r->right) + 1) {
+            r->left = mid;
+            updateHeight(r);
+            return r;
+        }
+        r->left = leftRotate(mid);
+        updateHeight(r);
+        return rightRotate(r);
+    }
+    r->left = joinLeft(l, mid, r->left);
+    updateHeight(r);
+    if (height(r->left) > height(r->right) + 1)
+        return rightRotate(r);
+    return r;
+}
+// Function to join l, mid and r, reusing mid as the node that holds the middle key
+struct TreeNode* joinNode(struct TreeNode* l, struct TreeNode* mid, struct TreeNode* r) {
+    if (height(l) > height(r) + 1)
+        return joinRight(l, mid, r);
+    if (height(r) > height(l) + 1)
+        return joinLeft(l, mid, r);
+    mid->left = l;
+    mid->right = r;
+    updateHeight(mid);
+    return mid;
+}
+// Function to join two trees without a middle key (all keys of l < all keys of r)
+struct TreeNode* splitLast(struct TreeNode* root, struct TreeNode** last) {
+    struct TreeNode* rest;
+    if (root->right == NULL) {
+        *last = root;
+        rest = root->left;
+        root->left = NULL;
+        root->height = 1;
+        return rest;
+    }
+    rest = splitLast(root->right, last);
+    return joinNode(root->left, root, rest);
+}
+struct TreeNode* join2(struct TreeNode* l, struct TreeNode* r) {
+    struct TreeNode* last;
+    if (l == NULL)
+        return r;
+    l = splitLast(l, &last);
+    return joinNode(l, last, r);
+}
+// Function to split root into keys < key (*l) and keys > key (*r).
+// Returns the detached node holding key, or NULL when key is absent.
+struct TreeNode* splitNode(struct TreeNode* root, int key, struct TreeNode** l, struct TreeNode** r) {
+    struct TreeNode *found, *half;
+    if (root == NULL) {
+        *l = *r = NULL;
+        return NULL;
+    }
+    if (key == root->data) {
+        *l = root->left;
+        *r = root->right;
+        root->left = root->right = NULL;
+        root->height = 1;
+        return root;
+    }
+    if (key < root->data) {
+        found = splitNode(root->left, key, l, &half);
+        *r = joinNode(half, root, root->right);
+    } else {
+        found = splitNode(root->right, key, &half, r);
+        *l = joinNode(root->left, root, half);
+    }
+    return found;
+}
+// Function to join l, key and r into one AVL tree
+struct TreeNode* avl_join(struct TreeNode* l, int key, struct TreeNode* r) {
+    return joinNode(l, createNode(key), r);
+}
+// Function to split root around key; returns 1 if key was present (it is dropped)
+int avl_split(struct TreeNode* root, int key, struct TreeNode** l, struct TreeNode** r) {
+    struct TreeNode* found = splitNode(root, key, l, r);
+    free(found);
+    return found != NULL;
+}
+
+struct TreeNode* setOp(int op, struct TreeNode* a, struct TreeNode* b, wp_pool* pool);
+// Arguments of one recursive half, so it can run as a pool task
+struct SetOpArgs {
+    int op;
+    struct TreeNode *a, *b, *result;
+    wp_pool* pool;
+};
+void setOpTask(void* p) {
+    struct SetOpArgs* s = (struct SetOpArgs*)p;
+    s->result = setOp(s->op, s->a, s->b, s->pool);
+}
+// Function to apply op to a and b: split b around a's root, recurse on both halves, join back
+struct TreeNode* setOp(int op, struct TreeNode* a, struct TreeNode* b, wp_pool* pool) {
+    struct TreeNode *mid, *dup, *l, *r;
+    struct SetOpArgs left, right;
+    if (a == NULL) {
+        if (op == AVL_UNION)
+            return b;
+        freeAVLTree(b);
+        return NULL;
+    }
+    if (b == NULL) {
+        if (op == AVL_INTERSECT) {
+            freeAVLTree(a);
+            return NULL;
+        }
+        return a;
+    }
+    mid = a;
+    left.op = right.op = op;
+    left.pool = right.pool = pool;
+    left.a = a->left;
+    right.a = a->right;
+    dup = splitNode(b, mid->data, &left.b, &right.b);
+    if (pool != NULL && height(a) >= AVL_PAR_HEIGHT && height(b) >= AVL_PAR_HEIGHT) {
+        wp_task task;
+        wp_spawn(pool, &task, setOpTask, &left);
+        setOpTask(&right);
+        wp_sync(pool, &task);
+    } else {
+        setOpTask(&left);
+        setOpTask(&right);
+    }
+    l = left.result;
+    r = right.result;
+    // Keep mid if it belongs to the result, otherwise drop it and join without a middle key
+    if (op == AVL_UNION || (op == AVL_INTERSECT) == (dup != NULL)) {
+        free(dup);
+        return joinNode(l, mid, r);
+    }
+    free(dup);
+    free(mid);
+    return join2(l, r);
+}
+// Functions for the bulk set operations; pool may be NULL to run on the calling thread only
+struct TreeNode* avl_union(struct TreeNode* a, struct TreeNode* b, wp_pool* pool) {
+    return setOp(AVL_UNION, a, b, pool);
+}
+struct TreeNode* avl_intersection(struct TreeNode* a, struct TreeNode* b, wp_pool* pool) {
+    return setOp(AVL_INTERSECT, a, b, pool);
+}
+struct TreeNode* avl_difference(struct TreeNode* a, struct TreeNode* b, wp_pool* pool) {
+    return setOp(AVL_DIFFERENCE, a, b, pool);
+}
+
+// ---------- Threaded tree ----------
+// In a threaded tree every empty right link holds the node's in-order successor
+// (rthread = 1), so an ordered scan needs neither recursion nor a stack and can
+// resume from any node. avl_tinsert/avl_tdelete keep the threads valid through
+// the rotations; insert/deleteNode must not be used on a threaded tree.
+
+// Function to insert a key into a threaded AVL tree
+struct TreeNode* avl_tinsert(struct TreeNode* root, int key) {
+    return insertNode(root, key, key, NULL, 1);
+}
+// Function to delete a key from a threaded AVL tree
+struct TreeNode* avl_tdelete(struct TreeNode* root, int key) {
+    return removeNode(root, key, key, NULL, 1);
+}
+// Function to thread an ordinary AVL tree in place; *prev is the last node visited
+void threadNodes(struct TreeNode* root, struct TreeNode** prev) {
+    if (root == NULL)
+	return;
+    threadNodes(root->left, prev);
+    if (*prev != NULL && (*prev)->right == NULL)
+	setRight(*prev, NULL, root, 1);
+    *prev = root;
+    threadNodes(root->right, prev);
+}
+struct TreeNode* avl_thread(struct TreeNode* root) {
+    struct TreeNode* prev = NULL;
+    threadNodes(root, &prev);
+    if (prev != NULL)
+	prev->rthread = 1; // The largest key has a NULL thread
+    return root;
+}
+// Function to turn a threaded tree back into an ordinary AVL tree
+struct TreeNode* avl_unthread(struct TreeNode* root) {
+    if (root != NULL) {
+	avl_unthread(root->left);
+	if (root->rthread) {
+	    root->right = NULL;
+	    root->rthread = 0;
+	} else
+	    avl_unthread(root->right);
+    }
+    return root;
+}
+// Function to find the first node with data >= key, the starting point of a scan
+struct TreeNode* avl_iter_seek(struct TreeNode* root, int key) {
+    struct TreeNode* best = NULL;
+    while (root != NULL) {
+	if (root->data >= key) {
+	    best = root;
+	    root = root->left;
+	} else
+	    root = rightChild(root);
+    }
+    return best;
+}
+// Function to step to the in-order successor, O(1) amortized and without a stack
+struct TreeNode* avl_iter_next(struct TreeNode* node) {
+    struct TreeNode* next = node->right;
+    if (node->rthread || next == NULL)
+	return next;
+    while (next->left != NULL)
+	next = next->left;
+    return next;
+}
+
+// ---------- Interval tree ----------
+// A node can hold an interval [data, high] (a plain key k is the interval [k, k]).
+// Nodes order by start and then end, and maxHigh, the largest end in the subtree,
+// is kept up to date by the rotations, insert and delete. An overlap query skips
+// every subtree whose maxHigh is below a and everything right of a start beyond b,
+// so it costs O(log n) when nothing overlaps and grows with the number of results.
+
+// Function to insert the interval [low, high] into the AVL tree
+struct TreeNode* avl_interval_insert(struct TreeNode* root, int low, int high) {
+    return insertNode(root, low, high, NULL, 0);
+}
+// Function to delete the interval [low, high] from the AVL tree
+struct TreeNode* avl_interval_delete(struct TreeNode* root, int low, int high) {
+    return removeNode(root, low, high, NULL, 0);
+}
+// Function to collect intervals overlapping [a, b] in start order. At most cap nodes
+// are stored in out; the return value is the total number of overlapping intervals.
+int avl_overlaps(struct TreeNode* root, int a, int b, struct TreeNode** out, int cap) {
+    int count = 0;
+    if (root == NULL || root->maxHigh < a)
+	return 0;
+    count += avl_overlaps(root->left, a, b, out, cap);
+    if (root->data > b) // This and every later interval start after b
+	return count;
+    if (root->high >= a) {
+	if (count < cap)
+	    out[count] = root;
+	count++;
+    }
+    if (count < cap)
+	return count + avl_overlaps(rightChild(root), a, b, out + count, cap - count);
+    return count + avl_overlaps(rightChild(root), a, b, NULL, 0);
+}
+// Function to collect intervals containing the point x
+int avl_stab(struct TreeNode* root, int x, struct TreeNode** out, int cap) {
+    return avl_overlaps(root, x, x, out, cap);
+}
+
+// ---------- Batch mode ----------
+// "avltree -b [file]" replays a stream of operations from file (or stdin) instead
+// of the menu. One operation per line, a word followed by a key where needed:
+//     insert 42    delete 42    search 42    dump (or print): keys in order to stdout
+// Each word may be shortened to its first letter (i, d, s; p for print), and lines
+// starting with '#' are ignored. A key that does not fit in an int, or runs into
+// anything but a blank, a newline or a '#', is an error and the line is skipped.
+// Input is read in large blocks and parsed by hand; per-operation throughput is
+// reported on stderr at the end.
 
-void main() {
+#define BATCH_BLOCK (1 << 20) // bytes read from the input at a time
+
+// Structure for the block reader used by the batch parser
+struct BatchReader {
+    FILE* in;
+    char* buf;
+    size_t len, pos;
+    long line;
+};
+// Function to get the next input byte, or -1 at end of input
+int batchByte(struct BatchReader* r) {
+    if (r->pos == r->len) {
+	r->len = fread(r->buf, 1, BATCH_BLOCK, r->in);
+	r->pos = 0;
+	if (r->len == 0)
+	    return -1;
+    }
+    return (unsigned char)r->buf[r->pos++];
+}
+// Function to look at the next input byte without consuming it
+int batchPeek(struct BatchReader* r) {
+    int c = batchByte(r);
+    if (c != -1)
+	r->pos--;
+    return c;
+}
+// Function to skip spaces and tabs (not newlines)
+void batchSkipBlanks(struct BatchReader* r) {
+    int c;
+    while ((c = batchPeek(r)) == ' ' || c == '\t' || c == '\r')
+	r->pos++;
+}
+// Function to drop the rest of the current line
+void batchSkipLine(struct BatchReader* r) {
+    int c;
+    while ((c = batchByte(r)) != -1 && c != '\n')
+	;
+    r->line++;
+}
+// Function to read the operation word starting with the byte c; returns its
+// index in names[] of runBatch, or -1 for anything else
+int batchOp(struct BatchReader* r, int c) {
+    static const char* words[5] = {"insert", "delete", "search", "dump", "print"};
+    static const int ops[5] = {0, 1, 2, 3, 3};
+    char word[8];
+    int i, n = 0;
+    word[n++] = (char)c;
+    while ((c = batchPeek(r)) >= 'a' && c <= 'z') {
+	if (n < 7)
+	    word[n] = (char)c;
+	n++;
+	r->pos++;
+    }
+    if (n > 6) // Longer than any operation
+	return -1;
+    word[n] = '\0';
+    for (i = 0; i < 5; i++) // 'd' alone is delete, the first match
+	if (strcmp(word, words[i]) == 0 || (n == 1 && word[0] == words[i][0]))
+	    return ops[i];
+    return -1;
+}
+// Function to parse a signed decimal key; returns 0 if there is none
+int batchKey(struct BatchReader* r, int* key) {
+    int c, neg = 0, digits = 0;
+    long long v = 0;
+    batchSkipBlanks(r);
+    c = batchPeek(r);
+    if (c == '-' || c == '+') {
+	neg = (c == '-');
+	r->pos++;
+    }
+    while ((c = batchPeek(r)) >= '0' && c <= '9') {
+	if (v < 1LL << 40) // Past this it is out of range anyway; keep v from overflowing
+	    v = v * 10 + (c - '0');
+	r->pos++;
+	digits++;
+    }
+    c = batchPeek(r);
+    if (c != -1 && c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != '#')
+	return 0; // e.g. "12abc": reject the line rather than apply half of it
+    if (neg)
+	v = -v;
+    if (v < INT_MIN || v > INT_MAX)
+	return 0;
+    *key = (int)v;
+    return digits > 0;
+}
+// Function to search a key in the AVL tree
+struct TreeNode* search(struct TreeNode* root, int key) {
+    while (root != NULL && root->data != key)
+	root = key < root->data ? root->left : rightChild(root);
+    return root;
+}
+
+// ---------- Counted keys ----------
+// A multiset of plain keys keeps each distinct key in one node, with the number
+// of copies in count. avl_minsert bumps the count of a key that is already there
+// and avl_mdelete lowers it, so a repeat neither allocates nor rotates: only the
+// first copy of a key adds a node and only the last copy removes it. insert on its
+// own still drops repeats, and deleteNode removes a key with all of its copies.
+// The set operations treat a counted tree as the set of its keys.
+
+// Function to add one copy of key to a counted tree
+struct TreeNode* avl_minsert(struct TreeNode* root, int key) {
+    struct TreeNode* node = search(root, key);
+    if (node != NULL) {
+	node->count++;
+	return root;
+    }
+    return insert(root, key);
+}
+// Function to remove one copy of key from a counted tree
+struct TreeNode* avl_mdelete(struct TreeNode* root, int key) {
+    struct TreeNode* node = search(root, key);
+    if (node == NULL)
+	return root;
+    if (node->count > 1) {
+	node->count--;
+	return root;
+    }
+    return deleteNode(root, key);
+}
+// Function to get the number of copies of key in a counted tree
+int avl_mcount(struct TreeNode* root, int key) {
+    struct TreeNode* node = search(root, key);
+    return node != NULL ? node->count : 0;
+}
+// Function to read the clock in nanoseconds
+long long nowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+// Function to print the in-order keys of the tree to out
+void dumpTree(struct TreeNode* root, FILE* out) {
+    while (root != NULL) {
+	dumpTree(root->left, out);
+	fprintf(out, "%d\n", root->data);
+	root = rightChild(root);
+    }
+}
+// Function to run a batch of operations against a new tree; returns the number of bad lines
+int runBatch(FILE* in) {
+    const char* names[4] = {"insert", "delete", "search", "dump"};
+    long long count[4] = {0}, ns[4] = {0};
+    long long start, hits = 0, total = nowNs();
+    struct BatchReader r;
+    struct TreeNode* root = NULL;
+    int c, op, key, errors = 0;
+    r.in = in;
+    r.buf = (char*)malloc(BATCH_BLOCK);
+    r.len = r.pos = 0;
+    r.line = 1;
+    if (r.buf == NULL) {
+	fprintf(stderr, "Memory allocation failed\n");
+	return 1;
+    }
+    while ((c = batchByte(&r)) != -1) {
+	if (c == '\n') {
+	    r.line++;
+	    continue;
+	}
+	if (c == ' ' || c == '\t' || c == '\r')
+	    continue;
+	if (c == '#') {
+	    batchSkipLine(&r);
+	    continue;
+	}
+	op = batchOp(&r, c);
+	if (op < 0 || (op < 3 && !batchKey(&r, &key))) {
+	    fprintf(stderr, "line %ld: bad operation\n", r.line);
+	    errors++;
+	    batchSkipLine(&r);
+	    continue;
+	}
+	start = nowNs();
+	switch (op) {
+	    case 0:
+		root = insert(root, key);
+		break;
+	    case 1:
+		root = deleteNode(root, key);
+		break;
+	    case 2:
+		if (search(root, key) != NULL)
+		    hits++;
+		break;
+	    case 3:
+		dumpTree(root, stdout);
+		break;
+	}
+	ns[op] += nowNs() - start;
+	count[op]++;
+    }
+    total = nowNs() - total;
+    fprintf(stderr, "%-8s %12s %12s %10s\n", "op", "count", "ops/s", "ns/op");
+    for (op = 0; op < 4; op++) {
+	if (count[op] == 0)
+	    continue;
+	fprintf(stderr, "%-8s %12lld %12.0f %10.1f\n", names[op], count[op],
+		ns[op] > 0 ? count[op] * 1e9 / ns[op] : 0.0, (double)ns[op] / count[op]);
+    }
+    fprintf(stderr, "search hits: %lld, tree height: %d, total time: %.3f s\n",
+	    hits, height(root), total / 1e9);
+    freeAVLTree(root);
+    free(r.buf);
+    return errors;
+}
+
+#ifndef AVL_NO_MAIN // Defined by drivers that include this file, e.g. bench.c
+int main(int argc, char* argv[]) {
     struct TreeNode* root = NULL;
-    int choice, key;
-    clrscr();
+    struct TreeNode* other;
+    struct TreeNode* hits[64];
+    wp_pool* pool;
+    int choice, key, n, i;
+    char op;
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	FILE* in = stdin;
+	if (argc > 2 && strcmp(argv[2], "-") != 0 && (in = fopen(argv[2], "rb")) == NULL) {
+	    perror(argv[2]);
+	    return 1;
+	}
+	choice = runBatch(in);
+	if (in != stdin)
+	    fclose(in);
+	return choice != 0;
+    }
 	printf("\nAVL Tree Operations:\n");
 	printf("1. Insert a node\n");
 	printf("2. Delete a node\n");
 	printf("3. In-order Traversal\n");
 	printf("4. Exit\n");
+	printf("5. Union/intersection/difference with another set\n");
+	printf("6. Ordered scan from a key\n");
+	printf("7. Insert an interval\n");
+	printf("8. Intervals overlapping a range\n");
+	printf("9. Add one copy of a key (counted)\n");
+	printf("10. Remove one copy of a key (counted)\n");
     do{
 	printf("Enter your choice: ");
-	scanf("%d", &choice);
+	if (scanf("%d", &choice) != 1) // End of input
+	    choice = 4;
 	switch (choice) {
 	    case 1:
 			printf("Enter the key to insert: ");
@@ -202,10 +837,68 @@ void main() {
 			freeAVLTree(root);
 			printf("Exiting...\n");
 			break;
+	    case 5:
+			printf("Enter the operation (u/i/d): ");
+			scanf(" %c", &op);
+			printf("Enter the number of keys in the other set: ");
+			scanf("%d", &n);
+			other = NULL;
+			for (i = 0; i < n; i++) {
+			    scanf("%d", &key);
+			    other = insert(other, key);
+			}
+			pool = wp_create(0); // Only for the duration of the operation
+			if (op == 'u')
+			    root = avl_union(root, other, pool);
+			else if (op == 'i')
+			    root = avl_intersection(root, other, pool);
+			else if (op == 'd')
+			    root = avl_difference(root, other, pool);
+			else {
+			    freeAVLTree(other);
+			    printf("Invalid operation!\n");
+			}
+			wp_destroy(pool);
+			break;
+	    case 6:
+			printf("Enter the start key and the number of keys to show: ");
+			scanf("%d %d", &key, &n);
+			root = avl_thread(root);
+			for (other = avl_iter_seek(root, key); other != NULL && n > 0; other = avl_iter_next(other), n--)
+			    printf("%d ", other->data);
+			printf("\n");
+			root = avl_unthread(root);
+			break;
+	    case 7:
+			printf("Enter the interval start and end: ");
+			scanf("%d %d", &key, &n);
+			root = avl_interval_insert(root, key, n);
+			break;
+	    case 8:
+			printf("Enter the range start and end: ");
+			scanf("%d %d", &key, &n);
+			i = avl_overlaps(root, key, n, hits, 64);
+			for (n = 0; n < i && n < 64; n++)
+			    printf("[%d, %d] ", hits[n]->data, hits[n]->high);
+			printf("(%d overlapping)\n", i);
+			break;
+	    case 9:
+			printf("Enter the key to add a copy of: ");
+			scanf("%d", &key);
+			root = avl_minsert(root, key);
+			printf("%d copies of %d\n", avl_mcount(root, key), key);
+			break;
+	    case 10:
+			printf("Enter the key to remove a copy of: ");
+			scanf("%d", &key);
+			root = avl_mdelete(root, key);
+			printf("%d copies of %d\n", avl_mcount(root, key), key);
+			break;
 	    default:
 			printf("Invalid choice! Please enter a valid option.\n");
 	}
     } while (choice != 4);
-    getch();
+    return 0;
 
 }
+#endif
@@ -4,9 +4,14 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #define ORDER 5
+// Keys are counted: a key inserted again bumps the count stored next to it
+// instead of taking another slot, and deleting it lowers the count. Only the
+// first copy of a key takes a slot and only the last one frees it, so repeats
+// never shift keys[] or split nodes.
 // Node structure of the B-Tree
 struct BTreeNode {
     int keys[ORDER - 1]; // Array to store keys
+    int counts[ORDER - 1]; // Number of copies of each key
     struct BTreeNode *children[ORDER]; // Array of child pointers
     bool leaf; // Flag to indicate if node is a leaf or not
     int num_keys; // Number of keys currently in the node
@@ -28,8 +33,8 @@ void splitChild(struct BTreeNode *parent, int i);
 void deleteKey(struct BTreeNode **root, int key);
 void deleteKeyHelper(struct BTreeNode *node, int key);
 void removeFromLeaf(struct BTreeNode *node, int idx);
-int getPredecessor(struct BTreeNode *node, int idx);
-int getSuccessor(struct BTreeNode *node, int idx);
+int getPredecessor(struct BTreeNode *node, int idx, int *count);
+int getSuccessor(struct BTreeNode *node, int idx, int *count);
 void mergeChildren(struct BTreeNode *node, int idx);
 void fill(struct BTreeNode *node, int idx);
 void borrowFromPrev(struct BTreeNode *node, int idx);
@@ -49,12 +54,32 @@ bool search(struct BTreeNode *root, int key) {
     }
     return search(root->children[i], key); // Recursively search in the appropriate child
 }
+// Function to find the count of a key in the B-Tree, or NULL if the key is absent
+int *findCount(struct BTreeNode *root, int key) {
+    while (root != NULL) {
+        int i = 0;
+        while (i < root->num_keys && key > root->keys[i]) {
+            i++;
+        }
+        if (i < root->num_keys && key == root->keys[i]) {
+            return &root->counts[i];
+        }
+        root = root->leaf ? NULL : root->children[i];
+    }
+    return NULL;
+}
 // Function to insert a key into the B-Tree
 void insert(struct BTreeNode **root, int key) {
     struct BTreeNode *node = *root;
+    int *count = findCount(node, key);
+    if (count != NULL) {
+        (*count)++; // Another copy of a key already present
+        return;
+    }
     if (node == NULL) {
         *root = createNode(true);
         (*root)->keys[0] = key;
+        (*root)->counts[0] = 1;
         (*root)->num_keys = 1;
     } else {
         if (node->num_keys == ORDER - 1) {
@@ -74,9 +99,11 @@ void insertNonFull(struct BTreeNode *node, int key) {
     if (node->leaf) {
         while (i >= 0 && key < node->keys[i]) {
             node->keys[i + 1] = node->keys[i];
+            node->counts[i + 1] = node->counts[i];
             i--;
         }
         node->keys[i + 1] = key;
+        node->counts[i + 1] = 1;
         node->num_keys++;
     } else {
         while (i >= 0 && key < node->keys[i]) {
@@ -99,6 +126,7 @@ void splitChild(struct BTreeNode *parent, int i) {
     newChild->num_keys = ORDER / 2 - 1;
     for (int j = 0; j < ORDER / 2 - 1; j++) {
         newChild->keys[j] = child->keys[j + ORDER / 2];
+        newChild->counts[j] = child->counts[j + ORDER / 2];
     }
     if (!child->leaf) {
         for (int j = 0; j < ORDER / 2; j++) {
@@ -112,20 +140,27 @@ void splitChild(struct BTreeNode *parent, int i) {
     parent->children[i + 1] = newChild;
     for (int j = parent->num_keys - 1; j >= i; j--) {
         parent->keys[j + 1] = parent->keys[j];
+        parent->counts[j + 1] = parent->counts[j];
     }
     parent->keys[i] = child->keys[ORDER / 2 - 1];
+    parent->counts[i] = child->counts[ORDER / 2 - 1];
     parent->num_keys++;
 }
-// Function to delete a key from the B-Tree
+// Function to delete one copy of a key from the B-Tree
 void deleteKey(struct BTreeNode **root, int key) {
     struct BTreeNode *node = *root;
+    int *count = findCount(node, key);
+    if (count != NULL && *count > 1) {
+        (*count)--; // Other copies remain, the key keeps its slot
+        return;
+    }
     deleteKeyHelper(node, key);
     if (node->num_keys == 0 && !node->leaf) {
         *root = node->children[0];
         free(node);
     }
 }
-// Function to delete a key from a B-Tree node
+// Function to delete a key, with all its copies, from a B-Tree node
 void deleteKeyHelper(struct BTreeNode *node, int key) {
     int i = 0;
     while (i < node->num_keys && key > node->keys[i]) {
@@ -136,11 +171,11 @@ void deleteKeyHelper(struct BTreeNode *node, int key) {
             removeFromLeaf(node, i);
         } else {
             if (node->children[i]->num_keys >= ORDER / 2) {
-                int predecessor = getPredecessor(node, i);
+                int predecessor = getPredecessor(node, i, &node->counts[i]);
                 node->keys[i] = predecessor;
                 deleteKeyHelper(node->children[i], predecessor);
             } else if (node->children[i + 1]->num_keys >= ORDER / 2) {
-                int successor = getSuccessor(node, i);
+                int successor = getSuccessor(node, i, &node->counts[i]);
                 node->keys[i] = successor;
                 deleteKeyHelper(node->children[i + 1], successor);
             } else {
@@ -162,23 +197,26 @@ void deleteKeyHelper(struct BTreeNode *node, int key) {
 void removeFromLeaf(struct BTreeNode *node, int idx) {
     for (int i = idx + 1; i < node->num_keys; i++) {
         node->keys[i - 1] = node->keys[i];
+        node->counts[i - 1] = node->counts[i];
     }
     node->num_keys--;
 }
-// Function to get predecessor key in a B-Tree node
-int getPredecessor(struct BTreeNode *node, int idx) {
+// Function to get predecessor key in a B-Tree node; *count receives its count
+int getPredecessor(struct BTreeNode *node, int idx, int *count) {
     struct BTreeNode *curr = node->children[idx];
     while (!curr->leaf) {
         curr = curr->children[curr->num_keys];
     }
+    *count = curr->counts[curr->num_keys - 1];
     return curr->keys[curr->num_keys - 1];
 }
-// Function to get successor key in a B-Tree node
-int getSuccessor(struct BTreeNode *node, int idx) {
+// Function to get successor key in a B-Tree node; *count receives its count
+int getSuccessor(struct BTreeNode *node, int idx, int *count) {
     struct BTreeNode *curr = node->children[idx + 1];
     while (!curr->leaf) {
         curr = curr->children[0];
     }
+    *count = curr->counts[0];
     return curr->keys[0];
 }
 // Function to merge a child node with its sibling
@@ -186,8 +224,10 @@ void mergeChildren(struct BTreeNode *node, int idx) {
     struct BTreeNode *child = node->children[idx];
     struct BTreeNode *sibling = node->children[idx + 1];
     child->keys[ORDER / 2 - 1] = node->keys[idx];
+    child->counts[ORDER / 2 - 1] = node->counts[idx];
     for (int i = 0; i < sibling->num_keys; i++) {
         child->keys[i + ORDER / 2] = sibling->keys[i];
+        child->counts[i + ORDER / 2] = sibling->counts[i];
     }
     if (!child->leaf) {
         for (int i = 0; i <= sibling->num_keys; i++) {
@@ -198,6 +238,7 @@ void mergeChildren(struct BTreeNode *node, int idx) {
     free(sibling);
     for (int i = idx + 1; i < node->num_keys; i++) {
         node->keys[i - 1] = node->keys[i];
+        node->counts[i - 1] = node->counts[i];
     }
     for (int i = idx + 2; i <= node->num_keys; i++) {
         node->children[i - 1] = node->children[i];
@@ -224,6 +265,7 @@ void borrowFromPrev(struct BTreeNode *node, int idx) {
     struct BTreeNode *sibling = node->children[idx - 1];
     for (int i = child->num_keys - 1; i >= 0; i--) {
         child->keys[i + 1] = child->keys[i];
+        child->counts[i + 1] = child->counts[i];
     }
     if (!child->leaf) {
         for (int i = child->num_keys; i >= 0; i--) {
@@ -231,10 +273,12 @@ void borrowFromPrev(struct BTreeNode *node, int idx) {
         }
     }
     child->keys[0] = node->keys[idx - 1];
+    child->counts[0] = node->counts[idx - 1];
     if (!child->leaf) {
         child->children[0] = sibling->children[sibling->num_keys];
     }
     node->keys[idx - 1] = sibling->keys[sibling->num_keys - 1];
+    node->counts[idx - 1] = sibling->counts[sibling->num_keys - 1];
     child->num_keys++;
     sibling->num_keys--;
 }
@@ -243,12 +287,15 @@ void borrowFromNext(struct BTreeNode *node, int idx) {
     struct BTreeNode *child = node->children[idx];
     struct BTreeNode *sibling = node->children[idx + 1];
     child->keys[child->num_keys] = node->keys[idx];
+    child->counts[child->num_keys] = node->counts[idx];
     if (!child->leaf) {
         child->children[child->num_keys + 1] = sibling->children[0];
     }
     node->keys[idx] = sibling->keys[0];
+    node->counts[idx] = sibling->counts[0];
     for (int i = 1; i < sibling->num_keys; i++) {
         sibling->keys[i - 1] = sibling->keys[i];
+        sibling->counts[i - 1] = sibling->counts[i];
     }
     if (!sibling->leaf) {
         for (int i = 1; i <= sibling->num_keys; i++) {
@@ -262,7 +309,11 @@ void borrowFromNext(struct BTreeNode *node, int idx) {
 void printTree(struct BTreeNode *root) {
     if (root != NULL) {
         for (int i = 0; i < root->num_keys; i++) {
-            printf("%d ", root->keys[i]);
+            if (root->counts[i] > 1) {
+                printf("%dx%d ", root->keys[i], root->counts[i]); // key x copies
+            } else {
+                printf("%d ", root->keys[i]);
+            }
         }
         printf("\n");
         if (!root->leaf) {
@@ -297,6 +348,12 @@ int main() {
             printf("Key %d not found in the B-Tree.\n", search_keys[i]);
         }
     }
+    // Repeated keys are counted in place
+    insert(&root, 6);
+    insert(&root, 6);
+    deleteKey(&root, 6);
+    printf("Key 6 inserted twice more and deleted once: %d copies\n", *findCount(root, 6));
     // Deleting keys from the B-Tree
    
     return 0;
+}
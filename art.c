@@ -0,0 +1,584 @@
+// Adaptive Radix Tree (Leis, Kemper, Neumann 2013) over int keys.
+// An ordered multiset with the same operations as the B-tree in "updated btree.c":
+// insert, search, remove and range count/sum, plus an in-order range walk.
+// Inner nodes come in four sizes (4, 16, 48 and 256 children) and grow or shrink as
+// children come and go. Every inner node also stores the key bytes that all keys
+// below it share (path compression), so there are no chains of one-child nodes.
+// Keys are handled as 4 big-endian bytes with the sign bit flipped, which makes
+// byte order equal to integer order.
+//
+// Build: gcc -O2 art.c -o art
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ART_KEY_BYTES 4
+
+enum { ART_LEAF, ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+// Header shared by leaves and the four inner node sizes
+typedef struct ArtNode {
+    unsigned char type;
+    unsigned char prefix_len;            // key bytes shared by every key below
+    unsigned short num;                  // children in use
+    unsigned char prefix[ART_KEY_BYTES];
+} ArtNode;
+
+typedef struct ArtLeaf {
+    ArtNode h;
+    unsigned key;   // encoded key, see art_encode
+    long count;     // copies of the key
+} ArtLeaf;
+
+typedef struct ArtNode4 {
+    ArtNode h;
+    unsigned char keys[4];   // sorted
+    ArtNode *children[4];
+} ArtNode4;
+
+typedef struct ArtNode16 {
+    ArtNode h;
+    unsigned char keys[16];  // sorted
+    ArtNode *children[16];
+} ArtNode16;
+
+typedef struct ArtNode48 {
+    ArtNode h;
+    unsigned char index[256]; // slot + 1 of each key byte's child, 0 = none
+    ArtNode *children[48];
+} ArtNode48;
+
+typedef struct ArtNode256 {
+    ArtNode h;
+    ArtNode *children[256];
+} ArtNode256;
+
+static unsigned art_encode(int k) {
+    return (unsigned)k ^ 0x80000000u;
+}
+
+static int art_decode(unsigned key) {
+    return (int)(key ^ 0x80000000u);
+}
+
+// Byte `depth` of an encoded key, most significant first
+static unsigned char art_byte(unsigned key, int depth) {
+    return (unsigned char)(key >> (8 * (ART_KEY_BYTES - 1 - depth)));
+}
+
+static size_t art_node_size(int type) {
+    switch (type) {
+    case ART_LEAF: return sizeof(ArtLeaf);
+    case ART_NODE4: return sizeof(ArtNode4);
+    case ART_NODE16: return sizeof(ArtNode16);
+    case ART_NODE48: return sizeof(ArtNode48);
+    default: return sizeof(ArtNode256);
+    }
+}
+
+static ArtNode *art_new_node(int type) {
+    ArtNode *n = (ArtNode *)calloc(1, art_node_size(type));
+    if (!n) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    n->type = (unsigned char)type;
+    return n;
+}
+
+static ArtNode *art_new_leaf(unsigned key) {
+    ArtLeaf *l = (ArtLeaf *)art_new_node(ART_LEAF);
+    l->key = key;
+    l->count = 1;
+    return &l->h;
+}
+
+// Slot holding the child for key byte b, or NULL
+static ArtNode **art_find_child(ArtNode *n, unsigned char b) {
+    switch (n->type) {
+    case ART_NODE4: {
+        ArtNode4 *x = (ArtNode4 *)n;
+        for (int i = 0; i < n->num; ++i)
+            if (x->keys[i] == b) return &x->children[i];
+        return NULL;
+    }
+    case ART_NODE16: {
+        ArtNode16 *x = (ArtNode16 *)n;
+#ifdef __SSE2__
+        // compare all 16 key bytes at once
+        __m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8((char)b), _mm_loadu_si128((const __m128i *)x->keys));
+        unsigned mask = (unsigned)_mm_movemask_epi8(eq) & ((1u << n->num) - 1);
+        return mask ? &x->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (int i = 0; i < n->num; ++i)
+            if (x->keys[i] == b) return &x->children[i];
+        return NULL;
+#endif
+    }
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)n;
+        return x->index[b] ? &x->children[x->index[b] - 1] : NULL;
+    }
+    default: {
+        ArtNode256 *x = (ArtNode256 *)n;
+        return x->children[b] ? &x->children[b] : NULL;
+    }
+    }
+}
+
+// Replace *ref by a node of another size holding the same header and children
+static void art_resize(ArtNode **ref, int type) {
+    ArtNode *old = *ref;
+    ArtNode *n = art_new_node(type);
+    n->prefix_len = old->prefix_len;
+    memcpy(n->prefix, old->prefix, ART_KEY_BYTES);
+
+    // collect the children in key order
+    unsigned char bytes[256];
+    ArtNode *kids[256];
+    int cnt = 0;
+    switch (old->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char *keys = old->type == ART_NODE4 ? ((ArtNode4 *)old)->keys : ((ArtNode16 *)old)->keys;
+        ArtNode **children = old->type == ART_NODE4 ? ((ArtNode4 *)old)->children : ((ArtNode16 *)old)->children;
+        for (int i = 0; i < old->num; ++i) {
+            bytes[cnt] = keys[i];
+            kids[cnt++] = children[i];
+        }
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)old;
+        for (int b = 0; b < 256; ++b) {
+            if (x->index[b]) {
+                bytes[cnt] = (unsigned char)b;
+                kids[cnt++] = x->children[x->index[b] - 1];
+            }
+        }
+        break;
+    }
+    default: {
+        ArtNode256 *x = (ArtNode256 *)old;
+        for (int b = 0; b < 256; ++b) {
+            if (x->children[b]) {
+                bytes[cnt] = (unsigned char)b;
+                kids[cnt++] = x->children[b];
+            }
+        }
+        break;
+    }
+    }
+
+    switch (type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char *keys = type == ART_NODE4 ? ((ArtNode4 *)n)->keys : ((ArtNode16 *)n)->keys;
+        ArtNode **children = type == ART_NODE4 ? ((ArtNode4 *)n)->children : ((ArtNode16 *)n)->children;
+        memcpy(keys, bytes, cnt);
+        memcpy(children, kids, sizeof(ArtNode *) * cnt);
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)n;
+        for (int i = 0; i < cnt; ++i) {
+            x->index[bytes[i]] = (unsigned char)(i + 1);
+            x->children[i] = kids[i];
+        }
+        break;
+    }
+    default: {
+        ArtNode256 *x = (ArtNode256 *)n;
+        for (int i = 0; i < cnt; ++i) x->children[bytes[i]] = kids[i];
+        break;
+    }
+    }
+    n->num = (unsigned short)cnt;
+    free(old);
+    *ref = n;
+}
+
+// Add child under key byte b (not present yet), growing *ref when it is full
+static void art_add_child(ArtNode **ref, unsigned char b, ArtNode *child) {
+    ArtNode *n = *ref;
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        int cap = n->type == ART_NODE4 ? 4 : 16;
+        if (n->num == cap) {
+            art_resize(ref, n->type == ART_NODE4 ? ART_NODE16 : ART_NODE48);
+            art_add_child(ref, b, child);
+            return;
+        }
+        unsigned char *keys = n->type == ART_NODE4 ? ((ArtNode4 *)n)->keys : ((ArtNode16 *)n)->keys;
+        ArtNode **children = n->type == ART_NODE4 ? ((ArtNode4 *)n)->children : ((ArtNode16 *)n)->children;
+        int i = n->num;
+        while (i > 0 && keys[i - 1] > b) {
+            keys[i] = keys[i - 1];
+            children[i] = children[i - 1];
+            i--;
+        }
+        keys[i] = b;
+        children[i] = child;
+        break;
+    }
+    case ART_NODE48: {
+        if (n->num == 48) {
+            art_resize(ref, ART_NODE256);
+            art_add_child(ref, b, child);
+            return;
+        }
+        ArtNode48 *x = (ArtNode48 *)n;
+        int slot = 0;
+        while (x->children[slot]) slot++;
+        x->children[slot] = child;
+        x->index[b] = (unsigned char)(slot + 1);
+        break;
+    }
+    default:
+        ((ArtNode256 *)n)->children[b] = child;
+        break;
+    }
+    n->num++;
+}
+
+// Drop the child under key byte b, shrinking *ref when it gets sparse. A Node4
+// left with one child is replaced by that child, which takes over its prefix.
+static void art_remove_child(ArtNode **ref, unsigned char b) {
+    ArtNode *n = *ref;
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char *keys = n->type == ART_NODE4 ? ((ArtNode4 *)n)->keys : ((ArtNode16 *)n)->keys;
+        ArtNode **children = n->type == ART_NODE4 ? ((ArtNode4 *)n)->children : ((ArtNode16 *)n)->children;
+        int i = 0;
+        while (keys[i] != b) i++;
+        for (; i + 1 < n->num; ++i) {
+            keys[i] = keys[i + 1];
+            children[i] = children[i + 1];
+        }
+        n->num--;
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)n;
+        x->children[x->index[b] - 1] = NULL;
+        x->index[b] = 0;
+        n->num--;
+        break;
+    }
+    default:
+        ((ArtNode256 *)n)->children[b] = NULL;
+        n->num--;
+        break;
+    }
+
+    if (n->type == ART_NODE256 && n->num <= 37) art_resize(ref, ART_NODE48);
+    else if (n->type == ART_NODE48 && n->num <= 12) art_resize(ref, ART_NODE16);
+    else if (n->type == ART_NODE16 && n->num <= 3) art_resize(ref, ART_NODE4);
+    else if (n->type == ART_NODE4 && n->num == 1) {
+        ArtNode4 *x = (ArtNode4 *)n;
+        ArtNode *child = x->children[0];
+        if (child->type != ART_LEAF) {
+            // child's prefix becomes n's prefix + the key byte + its own prefix
+            unsigned char prefix[ART_KEY_BYTES];
+            int len = 0;
+            memcpy(prefix, n->prefix, n->prefix_len);
+            len = n->prefix_len;
+            prefix[len++] = x->keys[0];
+            memcpy(prefix + len, child->prefix, child->prefix_len);
+            len += child->prefix_len;
+            memcpy(child->prefix, prefix, len);
+            child->prefix_len = (unsigned char)len;
+        }
+        free(n);
+        *ref = child;
+    }
+}
+
+static void art_insert_at(ArtNode **ref, unsigned key, int depth) {
+    ArtNode *n = *ref;
+    if (!n) {
+        *ref = art_new_leaf(key);
+        return;
+    }
+    if (n->type == ART_LEAF) {
+        ArtLeaf *l = (ArtLeaf *)n;
+        if (l->key == key) {
+            l->count++;
+            return;
+        }
+        // two different keys: a Node4 whose prefix is the bytes they share
+        ArtNode *x = art_new_node(ART_NODE4);
+        int p = 0;
+        while (art_byte(l->key, depth + p) == art_byte(key, depth + p)) {
+            x->prefix[p] = art_byte(key, depth + p);
+            p++;
+        }
+        x->prefix_len = (unsigned char)p;
+        art_add_child(&x, art_byte(l->key, depth + p), n);
+        art_add_child(&x, art_byte(key, depth + p), art_new_leaf(key));
+        *ref = x;
+        return;
+    }
+
+    int p = 0;
+    while (p < n->prefix_len && n->prefix[p] == art_byte(key, depth + p)) p++;
+    if (p < n->prefix_len) {
+        // key leaves the compressed path: split it with a new Node4 above n
+        ArtNode *x = art_new_node(ART_NODE4);
+        x->prefix_len = (unsigned char)p;
+        memcpy(x->prefix, n->prefix, p);
+        unsigned char nb = n->prefix[p];
+        n->prefix_len -= p + 1;
+        memmove(n->prefix, n->prefix + p + 1, n->prefix_len);
+        art_add_child(&x, nb, n);
+        art_add_child(&x, art_byte(key, depth + p), art_new_leaf(key));
+        *ref = x;
+        return;
+    }
+
+    depth += n->prefix_len;
+    ArtNode **child = art_find_child(n, art_byte(key, depth));
+    if (child) art_insert_at(child, key, depth + 1);
+    else art_add_child(ref, art_byte(key, depth), art_new_leaf(key));
+}
+
+// Insert one copy of k; returns the new root
+ArtNode *art_insert(ArtNode *root, int k) {
+    art_insert_at(&root, art_encode(k), 0);
+    return root;
+}
+
+bool art_search(ArtNode *root, int k) {
+    unsigned key = art_encode(k);
+    ArtNode *n = root;
+    int depth = 0;
+    while (n) {
+        if (n->type == ART_LEAF) return ((ArtLeaf *)n)->key == key;
+        for (int i = 0; i < n->prefix_len; ++i)
+            if (n->prefix[i] != art_byte(key, depth + i)) return false;
+        depth += n->prefix_len;
+        ArtNode **child = art_find_child(n, art_byte(key, depth));
+        if (!child) return false;
+        n = *child;
+        depth++;
+    }
+    return false;
+}
+
+// Returns true when a copy of key was removed
+static bool art_remove_at(ArtNode **ref, unsigned key, int depth) {
+    ArtNode *n = *ref;
+    if (!n) return false;
+    if (n->type == ART_LEAF) {
+        ArtLeaf *l = (ArtLeaf *)n;
+        if (l->key != key) return false;
+        if (--l->count == 0) {
+            free(n);
+            *ref = NULL;
+        }
+        return true;
+    }
+    for (int i = 0; i < n->prefix_len; ++i)
+        if (n->prefix[i] != art_byte(key, depth + i)) return false;
+    depth += n->prefix_len;
+    unsigned char b = art_byte(key, depth);
+    ArtNode **child = art_find_child(n, b);
+    if (!child || !art_remove_at(child, key, depth + 1)) return false;
+    if (!*child) art_remove_child(ref, b);
+    return true;
+}
+
+// Remove one copy of k; returns the new root
+ArtNode *art_remove(ArtNode *root, int k) {
+    art_remove_at(&root, art_encode(k), 0);
+    return root;
+}
+
+typedef void (*art_visit_fn)(int key, long count, void *arg);
+
+// In-order walk of the keys in [lo, hi]. lo_tight / hi_tight: the bytes seen so
+// far equal lo's / hi's, so the next byte is still bounded by it.
+static void art_range_at(ArtNode *n, int depth, unsigned lo, unsigned hi, bool lo_tight, bool hi_tight,
+                         art_visit_fn fn, void *arg) {
+    if (n->type == ART_LEAF) {
+        ArtLeaf *l = (ArtLeaf *)n;
+        if (l->key >= lo && l->key <= hi) fn(art_decode(l->key), l->count, arg);
+        return;
+    }
+    for (int i = 0; i < n->prefix_len; ++i) {
+        unsigned char b = n->prefix[i];
+        if (lo_tight) {
+            unsigned char lb = art_byte(lo, depth + i);
+            if (b < lb) return;
+            if (b > lb) lo_tight = false;
+        }
+        if (hi_tight) {
+            unsigned char hb = art_byte(hi, depth + i);
+            if (b > hb) return;
+            if (b < hb) hi_tight = false;
+        }
+    }
+    depth += n->prefix_len;
+    int first = lo_tight ? art_byte(lo, depth) : 0;
+    int last = hi_tight ? art_byte(hi, depth) : 255;
+    switch (n->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char *keys = n->type == ART_NODE4 ? ((ArtNode4 *)n)->keys : ((ArtNode16 *)n)->keys;
+        ArtNode **children = n->type == ART_NODE4 ? ((ArtNode4 *)n)->children : ((ArtNode16 *)n)->children;
+        for (int i = 0; i < n->num && keys[i] <= last; ++i) {
+            if (keys[i] < first) continue;
+            art_range_at(children[i], depth + 1, lo, hi, lo_tight && keys[i] == first,
+                         hi_tight && keys[i] == last, fn, arg);
+        }
+        break;
+    }
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)n;
+        for (int b = first; b <= last; ++b) {
+            if (!x->index[b]) continue;
+            art_range_at(x->children[x->index[b] - 1], depth + 1, lo, hi, lo_tight && b == first,
+                         hi_tight && b == last, fn, arg);
+        }
+        break;
+    }
+    default: {
+        ArtNode256 *x = (ArtNode256 *)n;
+        for (int b = first; b <= last; ++b) {
+            if (!x->children[b]) continue;
+            art_range_at(x->children[b], depth + 1, lo, hi, lo_tight && b == first,
+                         hi_tight && b == last, fn, arg);
+        }
+        break;
+    }
+    }
+}
+
+// Call fn for every distinct key in [lo, hi] in ascending order
+void art_range(ArtNode *root, int lo, int hi, art_visit_fn fn, void *arg) {
+    if (!root || lo > hi) return;
+    art_range_at(root, 0, art_encode(lo), art_encode(hi), true, true, fn, arg);
+}
+
+typedef struct { long cnt; long long sum; } art_totals;
+
+static void art_add_totals(int key, long count, void *arg) {
+    art_totals *t = (art_totals *)arg;
+    t->cnt += count;
+    t->sum += (long long)key * count;
+}
+
+// Number of keys in [lo, hi], copies included
+long art_range_count(ArtNode *root, int lo, int hi) {
+    art_totals t = {0, 0};
+    art_range(root, lo, hi, art_add_totals, &t);
+    return t.cnt;
+}
+
+// Sum of keys in [lo, hi]
+long long art_range_sum(ArtNode *root, int lo, int hi) {
+    art_totals t = {0, 0};
+    art_range(root, lo, hi, art_add_totals, &t);
+    return t.sum;
+}
+
+// Children of an inner node, in key order
+static int art_children(ArtNode *n, ArtNode **out) {
+    int cnt = 0;
+    switch (n->type) {
+    case ART_NODE4:
+        for (int i = 0; i < n->num; ++i) out[cnt++] = ((ArtNode4 *)n)->children[i];
+        break;
+    case ART_NODE16:
+        for (int i = 0; i < n->num; ++i) out[cnt++] = ((ArtNode16 *)n)->children[i];
+        break;
+    case ART_NODE48: {
+        ArtNode48 *x = (ArtNode48 *)n;
+        for (int b = 0; b < 256; ++b)
+            if (x->index[b]) out[cnt++] = x->children[x->index[b] - 1];
+        break;
+    }
+    case ART_NODE256: {
+        ArtNode256 *x = (ArtNode256 *)n;
+        for (int b = 0; b < 256; ++b)
+            if (x->children[b]) out[cnt++] = x->children[b];
+        break;
+    }
+    }
+    return cnt;
+}
+
+// Node memory in bytes; nodes[type] receives the node count of each kind
+size_t art_memory(ArtNode *root, long nodes[ART_NODE256 + 1]) {
+    if (!root) return 0;
+    nodes[root->type]++;
+    size_t bytes = art_node_size(root->type);
+    if (root->type != ART_LEAF) {
+        ArtNode *kids[256];
+        int cnt = art_children(root, kids);
+        for (int i = 0; i < cnt; ++i) bytes += art_memory(kids[i], nodes);
+    }
+    return bytes;
+}
+
+void art_free(ArtNode *root) {
+    if (!root) return;
+    if (root->type != ART_LEAF) {
+        ArtNode *kids[256];
+        int cnt = art_children(root, kids);
+        for (int i = 0; i < cnt; ++i) art_free(kids[i]);
+    }
+    free(root);
+}
+
+#ifndef ART_NO_MAIN // Defined by drivers that include this file, e.g. bench.c
+static void art_print_key(int key, long count, void *arg) {
+    (void)arg;
+    if (count > 1) printf(" %dx%ld", key, count);
+    else printf(" %d", key);
+}
+
+int main(void) {
+    srand((unsigned)time(NULL));
+
+    const int N = 100;
+    int arr[100];
+    ArtNode *root = NULL;
+    printf("Inserting %d random keys in [1, 1000] into the ART...\n", N);
+    for (int i = 0; i < N; ++i) {
+        arr[i] = 1 + rand() % 1000;
+        root = art_insert(root, arr[i]);
+    }
+
+    printf("\nKeys in [100, 300]:");
+    art_range(root, 100, 300, art_print_key, NULL);
+    printf("\n");
+    printf("Keys in [100, 500]: count=%ld sum=%lld\n",
+           art_range_count(root, 100, 500), art_range_sum(root, 100, 500));
+
+    printf("\nSearch demo:\n");
+    int to_search[5] = {arr[0], arr[10], arr[20], 9999, arr[99]};
+    for (int i = 0; i < 5; ++i)
+        printf("Searching %d -> %s\n", to_search[i], art_search(root, to_search[i]) ? "FOUND" : "NOT FOUND");
+
+    printf("\nDeleting 10 keys (first 10 inserted)\n");
+    for (int i = 0; i < 10; ++i) root = art_remove(root, arr[i]);
+    printf("Keys left: %ld\n", art_range_count(root, -2147483647 - 1, 2147483647));
+
+    long nodes[ART_NODE256 + 1] = {0};
+    size_t bytes = art_memory(root, nodes);
+    printf("Memory: %zu bytes (leaves=%ld node4=%ld node16=%ld node48=%ld node256=%ld)\n", bytes,
+           nodes[ART_LEAF], nodes[ART_NODE4], nodes[ART_NODE16], nodes[ART_NODE48], nodes[ART_NODE256]);
+
+    art_free(root);
+    return 0;
+}
+#endif
@@ -0,0 +1,267 @@
+// Benchmark driver for the search trees in this repository.
+// Runs the same workload (insert, hit lookups, miss lookups, removals) against
+// every engine and reports ns/op. The bt-bfs and bt-veb engines compact the
+// B-tree after the insert phase, so their lookups show the layout's effect, and
+// frozen answers the lookups from bt_freeze's read-only copy of the tree and
+// also reports that copy's size.
+// bt-relaxed removes with bt_remove_relaxed and bt-tomb through tombstones;
+// bt-filter puts the counting Bloom filter in front of the tree and bt-cache the
+// hot-key cache, which pays off with the skewed lookups of -z. bt-dir splits the
+// keys over a radix directory of subtrees, which turns its dense slots into
+// bitmaps. art is the Adaptive Radix Tree from art.c.
+// With -p it also reads Linux hardware counters (instructions, branch/L1d/LLC/
+// dTLB misses) around each phase and reports them per operation. Counters that
+// the machine does not expose print as "-".
+//
+// Build: gcc -O2 -pthread bench.c -o bench
+// Usage: ./bench [-n keys] [-s seed] [-e engine] [-p] [-l] [-z]
+//        -l uses ascending (local) key streams instead of random ones
+//        -z skews the lookups: 9 in 10 go to BENCH_HOT_KEYS hot keys
+
+#define AVL_NO_MAIN
+#define BT_NO_MAIN
+#define ART_NO_MAIN
+#include "Avltree.c"
+#include "updated btree.c"
+#include "art.c"
+#include "perfcount.h"
+
+// One tree implementation behind a common interface; t is the tree's root handle
+typedef struct bench_engine {
+    const char *name;
+    void *(*insert)(void *t, int k);
+    bool (*search)(void *t, int k);
+    void *(*remove)(void *t, int k); // NULL for read-only engines: no remove phase
+    void (*destroy)(void *t);
+    void *(*prepare)(void *t); // optional, run untimed between the insert and lookup phases
+    size_t (*bytes)(void *t);  // optional: heap bytes of the structure the lookups run on
+} bench_engine;
+
+static void *bench_bt_insert(void *t, int k) { return bt_insert((BTreeNode *)t, k); }
+static bool bench_bt_search(void *t, int k) { return bt_search((BTreeNode *)t, k); }
+static void *bench_bt_remove(void *t, int k) { return bt_remove((BTreeNode *)t, k); }
+static void *bench_bt_remove_relaxed(void *t, int k) { return bt_remove_relaxed((BTreeNode *)t, k); }
+static void bench_bt_destroy(void *t) { bt_free((BTreeNode *)t); }
+static void *bench_bt_bfs(void *t) { return bt_compact((BTreeNode *)t, BT_LAYOUT_BFS); }
+static void *bench_bt_veb(void *t) { return bt_compact((BTreeNode *)t, BT_LAYOUT_VEB); }
+static void *bench_freeze(void *t) {
+    bt_frozen *f = bt_freeze((BTreeNode *)t);
+    bt_free((BTreeNode *)t);
+    return f;
+}
+static bt_finger bench_finger;
+static void *bench_finger_insert(void *t, int k) { return bt_finger_insert(&bench_finger, (BTreeNode *)t, k); }
+static bool bench_finger_search(void *t, int k) { return bt_finger_search(&bench_finger, (BTreeNode *)t, k); }
+static bt_tombs bench_tombs;
+static void *bench_tomb_remove(void *t, int k) { return bt_tomb_delete(&bench_tombs, (BTreeNode *)t, k); }
+static bool bench_tomb_search(void *t, int k) { return bt_tomb_search(&bench_tombs, (BTreeNode *)t, k); }
+static bt_filter bench_filter;
+static void *bench_filter_insert(void *t, int k) { return bt_filter_insert(&bench_filter, (BTreeNode *)t, k); }
+static bool bench_filter_search(void *t, int k) { return bt_filter_search(&bench_filter, (BTreeNode *)t, k); }
+static void *bench_filter_remove(void *t, int k) { return bt_filter_remove(&bench_filter, (BTreeNode *)t, k); }
+static bt_cache bench_cache;
+static void *bench_cache_insert(void *t, int k) { return bt_cache_insert(&bench_cache, (BTreeNode *)t, k); }
+static bool bench_cache_search(void *t, int k) { return bt_cache_search(&bench_cache, (BTreeNode *)t, k); }
+static void *bench_cache_remove(void *t, int k) { return bt_cache_remove(&bench_cache, (BTreeNode *)t, k); }
+static bt_dir bench_dir; // set up and freed by main; t just points at it
+static void *bench_dir_insert(void *t, int k) { (void)t; bt_dir_insert(&bench_dir, k); return &bench_dir; }
+static bool bench_dir_search(void *t, int k) { (void)t; return bt_dir_search(&bench_dir, k); }
+static void *bench_dir_remove(void *t, int k) { (void)t; bt_dir_remove(&bench_dir, k); return &bench_dir; }
+static void bench_dir_destroy(void *t) { (void)t; }
+static bool bench_frozen_search(void *t, int k) { return bt_frozen_search((bt_frozen *)t, k); }
+static void bench_frozen_destroy(void *t) { bt_frozen_free((bt_frozen *)t); }
+static size_t bench_frozen_bytes(void *t) { return bt_frozen_bytes((bt_frozen *)t); }
+
+static void *bench_avl_insert(void *t, int k) { return insert((struct TreeNode *)t, k); }
+static bool bench_avl_search(void *t, int k) { return search((struct TreeNode *)t, k) != NULL; }
+static void *bench_avl_remove(void *t, int k) { return deleteNode((struct TreeNode *)t, k); }
+static void bench_avl_destroy(void *t) { freeAVLTree((struct TreeNode *)t); }
+
+static void *bench_art_insert(void *t, int k) { return art_insert((ArtNode *)t, k); }
+static bool bench_art_search(void *t, int k) { return art_search((ArtNode *)t, k); }
+static void *bench_art_remove(void *t, int k) { return art_remove((ArtNode *)t, k); }
+static void bench_art_destroy(void *t) { art_free((ArtNode *)t); }
+
+static const bench_engine bench_engines[] = {
+    {"btree", bench_bt_insert, bench_bt_search, bench_bt_remove, bench_bt_destroy, NULL, NULL},
+    {"bt-bfs", bench_bt_insert, bench_bt_search, bench_bt_remove, bench_bt_destroy, bench_bt_bfs, NULL},
+    {"bt-veb", bench_bt_insert, bench_bt_search, bench_bt_remove, bench_bt_destroy, bench_bt_veb, NULL},
+    {"bt-finger", bench_finger_insert, bench_finger_search, bench_bt_remove, bench_bt_destroy, NULL, NULL},
+    {"bt-relaxed", bench_bt_insert, bench_bt_search, bench_bt_remove_relaxed, bench_bt_destroy, NULL, NULL},
+    {"bt-tomb", bench_bt_insert, bench_tomb_search, bench_tomb_remove, bench_bt_destroy, NULL, NULL},
+    {"bt-filter", bench_filter_insert, bench_filter_search, bench_filter_remove, bench_bt_destroy, NULL, NULL},
+    {"bt-cache", bench_cache_insert, bench_cache_search, bench_cache_remove, bench_bt_destroy, NULL, NULL},
+    {"bt-dir", bench_dir_insert, bench_dir_search, bench_dir_remove, bench_dir_destroy, NULL, NULL},
+    {"frozen", bench_bt_insert, bench_frozen_search, NULL, bench_frozen_destroy, bench_freeze, bench_frozen_bytes},
+    {"avl", bench_avl_insert, bench_avl_search, bench_avl_remove, bench_avl_destroy, NULL, NULL},
+    {"art", bench_art_insert, bench_art_search, bench_art_remove, bench_art_destroy, NULL, NULL},
+};
+#define BENCH_ENGINES ((int)(sizeof(bench_engines) / sizeof(bench_engines[0])))
+
+enum { PH_INSERT, PH_HIT, PH_MISS, PH_REMOVE, PH_COUNT };
+static const char *bench_phase_names[PH_COUNT] = {"insert", "search-hit", "search-miss", "remove"};
+
+static unsigned long long bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long bench_rng;
+static unsigned long long bench_rand(void) {
+    bench_rng ^= bench_rng << 13;
+    bench_rng ^= bench_rng >> 7;
+    bench_rng ^= bench_rng << 17;
+    return bench_rng;
+}
+
+static void bench_shuffle(int *a, int n) {
+    for (int i = n - 1; i > 0; --i) {
+        int j = (int)(bench_rand() % (unsigned long long)(i + 1));
+        int tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+    }
+}
+
+// Present keys are even, so odd keys are guaranteed misses. Local streams keep
+// them in ascending order, the best case for finger search.
+static void bench_make_keys(int *present, int *absent, int n, bool local) {
+    for (int i = 0; i < n; ++i) {
+        present[i] = 2 * i;
+        absent[i] = 2 * i + 1;
+    }
+    if (local) return;
+    bench_shuffle(present, n);
+    bench_shuffle(absent, n);
+}
+
+#define BENCH_HOT_KEYS 4096
+
+// Redirect 9 in 10 lookups to the first BENCH_HOT_KEYS entries of the array
+static void bench_skew(int *probe, int n) {
+    int hot = n < BENCH_HOT_KEYS ? n : BENCH_HOT_KEYS;
+    for (int i = hot; i < n; ++i) {
+        if (bench_rand() % 10 != 0) probe[i] = probe[bench_rand() % (unsigned long long)hot];
+    }
+}
+
+static void bench_report(const char *engine, int phase, long ops, unsigned long long ns,
+                         const pc_counters *pc, bool perf) {
+    printf("%-10s %-12s %10ld %9.1f", engine, bench_phase_names[phase], ops, (double)ns / ops);
+    if (perf) {
+        for (int e = 0; e < PC_EVENTS; ++e) {
+            if (pc_available(pc, e)) printf(" %10.2f", (double)pc->value[e] / ops);
+            else printf(" %10s", "-");
+        }
+    }
+    printf("\n");
+}
+
+static void bench_run(const bench_engine *eng, const int *keys, const int *probe,
+                      const int *misses, int n, pc_counters *pc, bool perf) {
+    void *t = NULL;
+    volatile long found = 0; // keeps the lookups from being optimised away
+    for (int phase = 0; phase < PH_COUNT; ++phase) {
+        long ops = (phase == PH_REMOVE) ? n / 2 : n;
+        if (phase == PH_REMOVE && !eng->remove) continue;
+        if (perf) pc_start(pc);
+        unsigned long long start = bench_now_ns();
+        switch (phase) {
+        case PH_INSERT:
+            for (int i = 0; i < n; ++i) t = eng->insert(t, keys[i]);
+            break;
+        case PH_HIT:
+            for (int i = 0; i < n; ++i) found += eng->search(t, probe[i]);
+            break;
+        case PH_MISS:
+            for (int i = 0; i < n; ++i) found += eng->search(t, misses[i]);
+            break;
+        case PH_REMOVE:
+            for (long i = 0; i < ops; ++i) t = eng->remove(t, keys[i]);
+            break;
+        }
+        unsigned long long ns = bench_now_ns() - start;
+        if (perf) pc_stop(pc);
+        bench_report(eng->name, phase, ops, ns, pc, perf);
+        if (phase == PH_INSERT && eng->prepare) t = eng->prepare(t);
+        if (phase == PH_INSERT && eng->bytes)
+            printf("%-10s %-12s %10d %9.2f bytes/key\n", eng->name, "memory", n, (double)eng->bytes(t) / n);
+    }
+    if (found != n) fprintf(stderr, "%s: expected %d hits, got %ld\n", eng->name, n, (long)found);
+    eng->destroy(t);
+}
+
+int main(int argc, char **argv) {
+    int n = 1000000;
+    bool perf = false, local = false, skew = false;
+    const char *only = NULL;
+    bench_rng = 88172645463325252ULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) n = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) bench_rng = strtoull(argv[++i], NULL, 10) | 1;
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) only = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0) perf = true;
+        else if (strcmp(argv[i], "-l") == 0) local = true;
+        else if (strcmp(argv[i], "-z") == 0) skew = true;
+        else {
+            fprintf(stderr, "usage: %s [-n keys] [-s seed] [-e engine] [-p] [-l] [-z]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n <= 0) n = 1;
+
+    int *keys = malloc(sizeof(int) * n);
+    int *probe = malloc(sizeof(int) * n);
+    int *misses = malloc(sizeof(int) * n);
+    if (!keys || !probe || !misses) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    bench_make_keys(keys, misses, n, local);
+    memcpy(probe, keys, sizeof(int) * n);
+    if (!local) bench_shuffle(probe, n);
+    if (skew) {
+        bench_skew(probe, n);
+        bench_skew(misses, n);
+    }
+
+    // every n/4096-th key, to size the radix directory
+    int nsample = n < 4096 ? n : 4096;
+    int *sample = malloc(sizeof(int) * nsample);
+    if (!sample) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < nsample; ++i) sample[i] = keys[(long)i * n / nsample];
+
+    pc_counters pc;
+    if (perf && pc_open(&pc) == 0) {
+        fprintf(stderr, "perf counters unavailable (perf_event_paranoid or container limits); timing only\n");
+        pc_close(&pc);
+        perf = false;
+    }
+
+    printf("%-10s %-12s %10s %9s", "engine", "phase", "ops", "ns/op");
+    if (perf) {
+        for (int e = 0; e < PC_EVENTS; ++e) printf(" %10s", pc_names[e]);
+    }
+    printf("\n");
+    for (int e = 0; e < BENCH_ENGINES; ++e) {
+        if (only && strcmp(only, bench_engines[e].name) != 0) continue;
+        bt_finger_init(&bench_finger);
+        bt_tombs_init(&bench_tombs);
+        bt_filter_init(&bench_filter, n, BT_FILTER_COUNTERS_PER_KEY, BT_FILTER_HASHES);
+        bt_cache_init(&bench_cache, BT_CACHE_SLOTS);
+        bt_dir_init(&bench_dir, sample, nsample, n);
+        bench_run(&bench_engines[e], keys, probe, misses, n, &pc, perf);
+        bt_filter_free(&bench_filter);
+        bt_cache_free(&bench_cache);
+        bt_dir_free(&bench_dir);
+    }
+
+    if (perf) pc_close(&pc);
+    free(keys);
+    free(probe);
+    free(misses);
+    free(sample);
+    return 0;
+}
@@ -0,0 +1,344 @@
+// Streaming bulk loader: reads key files into the B-tree of "updated btree.c".
+// Each file is mmap'ed and cut into fixed-size chunks. Parser threads claim
+// chunks, turn the decimal keys in them into an int array and, with -s, radix
+// sort it. The finished batches go through a bounded queue to the main thread,
+// the only one that touches the tree. Sorted batches are inserted through a
+// finger, so consecutive keys skip most of the descent. Parsing, sorting and
+// inserting overlap. The queue bound keeps at most threads + depth batches in
+// memory however large the file is.
+//
+// With -b the batches are gathered instead, and once every file is parsed the
+// tree is made in one go by bt_build, which sorts and builds on a thread pool.
+// That keeps every core busy for the tree too, at the price of holding all the
+// keys in memory.
+//
+// Keys are decimal integers, negative when a single '-' comes right before the
+// digits, separated by anything else (newlines, spaces, commas). A key may
+// straddle a chunk border; the chunk it starts in owns it. Numbers outside the
+// int range are not loaded; they are counted, and the run then exits with 1.
+//
+// Build: gcc -O2 -pthread ingest.c -o ingest
+// Usage: ./ingest [-t threads] [-c chunk_mb] [-q depth] [-s] [-b] file...
+
+#define BT_NO_MAIN
+#include "updated btree.c"
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct ingest_batch {
+    int *keys;
+    long n;
+    long rejected; // tokens outside the int range, skipped
+} ingest_batch;
+
+typedef struct ingest_job {
+    const char *data;  // the mapped file
+    size_t size;
+    size_t chunk;      // bytes per chunk
+    long nchunks;
+    long next_chunk;   // next chunk to claim, under lock
+    bool sort;
+
+    pthread_mutex_t lock;
+    pthread_cond_t not_full, not_empty;
+    ingest_batch *queue;  // ring buffer of finished batches
+    int depth, head, count;
+    int parsers_left;     // parser threads still running
+
+    unsigned long long parse_ns, sort_ns; // summed over parser threads
+} ingest_job;
+
+static unsigned long long ingest_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool ingest_is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Parse the keys that start inside [begin, end) of the buffer
+static ingest_batch ingest_parse(const char *data, size_t size, size_t begin, size_t end) {
+    ingest_batch b;
+    size_t cap = (end - begin) / 2 + 16; // a key takes at least two bytes with its separator
+    b.keys = (int *)malloc(sizeof(int) * cap);
+    b.n = 0;
+    b.rejected = 0;
+    if (!b.keys) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t p = begin;
+    // A key is a run of digits, with the '-' right before it as its sign, and
+    // starts at its first byte. One that started in the previous chunk (at a
+    // digit or at its sign) belongs to that chunk.
+    if (p > 0 && p < size && ingest_is_digit(data[p]) && (ingest_is_digit(data[p - 1]) || data[p - 1] == '-'))
+        while (p < size && ingest_is_digit(data[p])) p++;
+    while (p < end) {
+        bool neg = data[p] == '-' && p + 1 < size && ingest_is_digit(data[p + 1]);
+        if (neg) p++;
+        else if (!ingest_is_digit(data[p])) {
+            p++;
+            continue;
+        }
+        long long v = 0;
+        while (p < size && ingest_is_digit(data[p])) {
+            if (v < 1LL << 40) v = v * 10 + (data[p] - '0');
+            p++;
+        }
+        if (neg) v = -v;
+        if (v > INT_MAX || v < INT_MIN) {
+            b.rejected++;
+            continue;
+        }
+        if ((size_t)b.n == cap) {
+            cap *= 2;
+            b.keys = (int *)realloc(b.keys, sizeof(int) * cap);
+            if (!b.keys) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        b.keys[b.n++] = (int)v;
+    }
+    return b;
+}
+
+// LSD radix sort, 8 bits per pass, sign bit flipped so negatives come first
+static void ingest_sort(int *keys, long n) {
+    unsigned *a = (unsigned *)keys;
+    unsigned *tmp = (unsigned *)malloc(sizeof(unsigned) * (n > 0 ? n : 1));
+    if (!tmp) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < n; ++i) a[i] ^= 0x80000000u;
+    for (int shift = 0; shift < 32; shift += 8) {
+        long count[257] = {0};
+        for (long i = 0; i < n; ++i) count[((a[i] >> shift) & 255) + 1]++;
+        for (int d = 0; d < 256; ++d) count[d + 1] += count[d];
+        for (long i = 0; i < n; ++i) tmp[count[(a[i] >> shift) & 255]++] = a[i];
+        unsigned *swap = a;
+        a = tmp;
+        tmp = swap;
+    }
+    // four passes: the sorted data is back in keys
+    for (long i = 0; i < n; ++i) a[i] ^= 0x80000000u;
+    free(tmp);
+}
+
+static void *ingest_parser(void *arg) {
+    ingest_job *job = (ingest_job *)arg;
+    unsigned long long parse_ns = 0, sort_ns = 0;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        long c = job->next_chunk < job->nchunks ? job->next_chunk++ : -1;
+        pthread_mutex_unlock(&job->lock);
+        if (c < 0) break;
+
+        size_t begin = (size_t)c * job->chunk;
+        size_t end = begin + job->chunk < job->size ? begin + job->chunk : job->size;
+        unsigned long long t0 = ingest_now_ns();
+        ingest_batch b = ingest_parse(job->data, job->size, begin, end);
+        unsigned long long t1 = ingest_now_ns();
+        if (job->sort) ingest_sort(b.keys, b.n);
+        parse_ns += t1 - t0;
+        sort_ns += ingest_now_ns() - t1;
+
+        pthread_mutex_lock(&job->lock);
+        while (job->count == job->depth) pthread_cond_wait(&job->not_full, &job->lock);
+        job->queue[(job->head + job->count) % job->depth] = b;
+        job->count++;
+        pthread_cond_signal(&job->not_empty);
+        pthread_mutex_unlock(&job->lock);
+    }
+    pthread_mutex_lock(&job->lock);
+    job->parse_ns += parse_ns;
+    job->sort_ns += sort_ns;
+    job->parsers_left--;
+    pthread_cond_signal(&job->not_empty);
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+typedef struct ingest_stats {
+    size_t bytes;
+    long keys;
+    long rejected; // out-of-range tokens that were not loaded
+    unsigned long long parse_ns, sort_ns, insert_ns, wait_ns;
+} ingest_stats;
+
+// Keys held back for bt_build (-b)
+typedef struct ingest_pending {
+    int *keys;
+    long n, cap;
+} ingest_pending;
+
+static void ingest_gather(ingest_pending *pend, const ingest_batch *b) {
+    if (pend->n + b->n > pend->cap) {
+        long cap = pend->cap ? pend->cap : 1 << 20;
+        while (cap < pend->n + b->n) cap *= 2;
+        pend->keys = (int *)realloc(pend->keys, sizeof(int) * cap);
+        if (!pend->keys) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        pend->cap = cap;
+    }
+    memcpy(pend->keys + pend->n, b->keys, sizeof(int) * b->n);
+    pend->n += b->n;
+}
+
+// Load one file into the tree, or into pend when it is not NULL; returns the new root
+static BTreeNode *ingest_file(BTreeNode *root, const char *path, int threads, size_t chunk,
+                              int depth, bool sort, ingest_pending *pend, ingest_stats *st) {
+    int fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) != 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return root;
+    }
+    if (sb.st_size == 0) {
+        close(fd);
+        return root;
+    }
+    void *map = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(path);
+        return root;
+    }
+    madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+
+    ingest_job job;
+    job.data = (const char *)map;
+    job.size = (size_t)sb.st_size;
+    job.chunk = chunk;
+    job.nchunks = (long)((job.size + chunk - 1) / chunk);
+    job.next_chunk = 0;
+    job.sort = sort;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.not_full, NULL);
+    pthread_cond_init(&job.not_empty, NULL);
+    job.queue = (ingest_batch *)malloc(sizeof(ingest_batch) * depth);
+    job.depth = depth;
+    job.head = job.count = 0;
+    job.parsers_left = threads;
+    job.parse_ns = job.sort_ns = 0;
+    pthread_t *tids = (pthread_t *)malloc(sizeof(pthread_t) * threads);
+    if (!job.queue || !tids) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < threads; ++i) pthread_create(&tids[i], NULL, ingest_parser, &job);
+
+    bt_finger finger;
+    bt_finger_init(&finger);
+    for (;;) {
+        unsigned long long t0 = ingest_now_ns();
+        pthread_mutex_lock(&job.lock);
+        while (job.count == 0 && job.parsers_left > 0) pthread_cond_wait(&job.not_empty, &job.lock);
+        if (job.count == 0) {
+            pthread_mutex_unlock(&job.lock);
+            break;
+        }
+        ingest_batch b = job.queue[job.head];
+        job.head = (job.head + 1) % job.depth;
+        job.count--;
+        pthread_cond_signal(&job.not_full);
+        pthread_mutex_unlock(&job.lock);
+        unsigned long long t1 = ingest_now_ns();
+
+        if (pend) {
+            ingest_gather(pend, &b);
+        } else if (sort) {
+            for (long i = 0; i < b.n; ++i) root = bt_finger_insert(&finger, root, b.keys[i]);
+        } else {
+            for (long i = 0; i < b.n; ++i) root = bt_insert(root, b.keys[i]);
+        }
+        st->wait_ns += t1 - t0;
+        st->insert_ns += ingest_now_ns() - t1;
+        st->keys += b.n;
+        st->rejected += b.rejected;
+        free(b.keys);
+    }
+
+    for (int i = 0; i < threads; ++i) pthread_join(tids[i], NULL);
+    st->bytes += job.size;
+    st->parse_ns += job.parse_ns;
+    st->sort_ns += job.sort_ns;
+    pthread_mutex_destroy(&job.lock);
+    pthread_cond_destroy(&job.not_full);
+    pthread_cond_destroy(&job.not_empty);
+    free(job.queue);
+    free(tids);
+    munmap(map, job.size);
+    return root;
+}
+
+static int ingest_usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-t threads] [-c chunk_mb] [-q depth] [-s] [-b] file...\n", prog);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = ncpu > 1 ? (int)ncpu - 1 : 1; // one core stays with the inserter
+    size_t chunk_mb = 4;
+    int depth = 0;
+    bool sort = false, build = false;
+    int first_file = argc;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) chunk_mb = (size_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) depth = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0) sort = true;
+        else if (strcmp(argv[i], "-b") == 0) build = true;
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "%s: unknown option %s\n", argv[0], argv[i]);
+            return ingest_usage(argv[0]);
+        } else {
+            first_file = i;
+            break;
+        }
+    }
+    if (first_file >= argc) return ingest_usage(argv[0]);
+    if (threads < 1) threads = 1;
+    if (chunk_mb < 1) chunk_mb = 1;
+    if (depth < 1) depth = 2 * threads;
+
+    ingest_stats st;
+    memset(&st, 0, sizeof(st));
+    ingest_pending pend = {NULL, 0, 0};
+    BTreeNode *root = NULL;
+    unsigned long long start = ingest_now_ns();
+    for (int i = first_file; i < argc; ++i)
+        root = ingest_file(root, argv[i], threads, chunk_mb << 20, depth, sort, build ? &pend : NULL, &st);
+    if (build) {
+        // the parsers are done, so the build gets their cores and the inserter's
+        unsigned long long t0 = ingest_now_ns();
+        wp_pool *pool = wp_create(threads + 1);
+        root = bt_build(pend.keys, pend.n, pool);
+        wp_destroy(pool);
+        st.insert_ns += ingest_now_ns() - t0;
+        free(pend.keys);
+    }
+    double secs = (ingest_now_ns() - start) / 1e9;
+
+    double mb = st.bytes / 1048576.0;
+    printf("Ingested %ld keys (%.1f MB) in %.3f s: %.1f MB/s, %.2f M keys/s\n", st.keys, mb, secs,
+           secs > 0 ? mb / secs : 0.0, secs > 0 ? st.keys / secs / 1e6 : 0.0);
+    if (st.rejected) printf("Rejected %ld tokens outside the int range; they were not loaded\n", st.rejected);
+    printf("Parser threads: %d, parse %.3f s + sort %.3f s busy in total; inserter: %s %.3f s, "
+           "waiting for batches %.3f s\n",
+           threads, st.parse_ns / 1e9, st.sort_ns / 1e9, build ? "bt_build" : "insert",
+           st.insert_ns / 1e9, st.wait_ns / 1e9);
+    printf("Tree holds %ld keys\n", bt_size(root));
+    bt_free(root);
+    return st.rejected ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+// Linux hardware performance counters around a benchmark phase.
+// Header only. Each event is opened on its own with perf_event_open, so a
+// machine (or container) that lacks some of them still reports the rest;
+// events that cannot be opened read as unavailable instead of failing.
+//
+//     pc_counters pc;
+//     pc_open(&pc);
+//     pc_start(&pc);
+//     ... phase ...
+//     pc_stop(&pc);              // pc.value[e] now holds the counts
+//     pc_close(&pc);
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+enum { PC_INSTRUCTIONS, PC_BRANCH_MISSES, PC_L1D_MISSES, PC_LLC_MISSES, PC_DTLB_MISSES, PC_EVENTS };
+
+static const char *pc_names[PC_EVENTS] = {"instr", "br-miss", "L1d-miss", "LLC-miss", "dTLB-miss"};
+
+typedef struct pc_counters {
+    int fd[PC_EVENTS];                 // -1 when the event is unavailable
+    unsigned long long value[PC_EVENTS]; // counts of the last start/stop window
+} pc_counters;
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static inline int pc_open_event(unsigned type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+#define PC_CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+// Open every event that this machine allows; returns how many could be opened
+static inline int pc_open(pc_counters *pc) {
+    int opened = 0;
+    pc->fd[PC_INSTRUCTIONS] = pc_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    pc->fd[PC_BRANCH_MISSES] = pc_open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    pc->fd[PC_L1D_MISSES] = pc_open_event(PERF_TYPE_HW_CACHE, PC_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D));
+    pc->fd[PC_LLC_MISSES] = pc_open_event(PERF_TYPE_HW_CACHE, PC_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL));
+    pc->fd[PC_DTLB_MISSES] = pc_open_event(PERF_TYPE_HW_CACHE, PC_CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB));
+    for (int e = 0; e < PC_EVENTS; ++e) {
+        pc->value[e] = 0;
+        if (pc->fd[e] >= 0) opened++;
+    }
+    return opened;
+}
+
+static inline void pc_start(pc_counters *pc) {
+    for (int e = 0; e < PC_EVENTS; ++e) {
+        if (pc->fd[e] < 0) continue;
+        ioctl(pc->fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Stop counting and read the values, scaled up if the kernel multiplexed the event
+static inline void pc_stop(pc_counters *pc) {
+    for (int e = 0; e < PC_EVENTS; ++e) {
+        unsigned long long buf[3]; // value, time enabled, time running
+        if (pc->fd[e] < 0) continue;
+        ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(pc->fd[e], buf, sizeof(buf)) != (ssize_t)sizeof(buf)) {
+            pc->value[e] = 0;
+            continue;
+        }
+        pc->value[e] = (buf[2] && buf[2] < buf[1])
+            ? (unsigned long long)((double)buf[0] * buf[1] / buf[2]) : buf[0];
+    }
+}
+
+static inline void pc_close(pc_counters *pc) {
+    for (int e = 0; e < PC_EVENTS; ++e) {
+        if (pc->fd[e] >= 0) close(pc->fd[e]);
+        pc->fd[e] = -1;
+    }
+}
+#else
+static inline int pc_open(pc_counters *pc) {
+    for (int e = 0; e < PC_EVENTS; ++e) {
+        pc->fd[e] = -1;
+        pc->value[e] = 0;
+    }
+    return 0;
+}
+static inline void pc_start(pc_counters *pc) { (void)pc; }
+static inline void pc_stop(pc_counters *pc) { (void)pc; }
+static inline void pc_close(pc_counters *pc) { (void)pc; }
+#endif
+
+static inline bool pc_available(const pc_counters *pc, int e) {
+    return pc->fd[e] >= 0;
+}
+
+#endif // PERFCOUNT_H
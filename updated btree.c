@@ -2,219 +2,709 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <time.h>
+#include <string.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "workpool.h" // thread pool for bt_build; link with -pthread
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #define T 3  // Minimum degree. Change T to adjust tree branching. T=3 => max keys = 2*T-1 = 5
 
-// B-Tree node structure
+// B-Tree node structure. Leaves only have the fields up to children[]; see
+// BT_LEAF_BYTES.
 typedef struct BTreeNode {
     int keys[2 * T - 1];
-    struct BTreeNode *children[2 * T];
     int n;           // current number of keys
     bool leaf;
+#ifdef BT_MULTISET
+    unsigned counts[2 * T - 1]; // copies of keys[i]; see "Counted keys"
+#endif
+    struct BTreeNode *children[2 * T];
+    long cnt[2 * T];      // number of keys in the subtree under children[i]
+    long long sum[2 * T]; // sum of the keys in the subtree under children[i]
 } BTreeNode;
 
+// ---- Operation counters and latency tracing ----
+// Build with -DBT_STATS (and -pthread) to count restructuring work (splits, merges,
+// borrows, fills) and per-operation nodes visited / key comparisons, and to sample
+// the latency of one in 2^BT_SAMPLE_SHIFT API calls into log2(ns) histograms.
+// Counters live in a per-thread block, so updating them is a plain increment;
+// bt_stats_collect sums the blocks of all threads on demand. Without BT_STATS the
+// hooks below compile to nothing.
+
+enum { BT_OP_SEARCH, BT_OP_INSERT, BT_OP_REMOVE, BT_OP_COUNT };
+
+#ifdef BT_STATS
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define BT_SAMPLE_SHIFT 6   // time 1 in 64 calls of each kind
+#define BT_LAT_BUCKETS 40   // bucket b holds latencies in [2^b, 2^(b+1)) ns
+
+typedef struct bt_stats {
+    unsigned long long splits, merges, borrows_prev, borrows_next, fills;
+    unsigned long long calls[BT_OP_COUNT];
+    unsigned long long nodes_visited[BT_OP_COUNT];
+    unsigned long long key_comparisons[BT_OP_COUNT];
+    unsigned long long latency[BT_OP_COUNT][BT_LAT_BUCKETS];
+    int cur_op;             // API call in progress on this thread
+    struct bt_stats *next;  // link in the list of all threads' blocks
+} bt_stats;
+
+static __thread bt_stats *bt_tls_stats;
+static bt_stats *bt_stats_head;
+static pthread_mutex_t bt_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Counter block of the calling thread, registered on first use. Blocks are never
+// freed, so counts of finished threads still show up in bt_stats_collect.
+static bt_stats *bt_stats_self(void) {
+    if (!bt_tls_stats) {
+        bt_stats *st = (bt_stats *)calloc(1, sizeof(bt_stats));
+        if (!st) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_lock(&bt_stats_lock);
+        st->next = bt_stats_head;
+        bt_stats_head = st;
+        pthread_mutex_unlock(&bt_stats_lock);
+        bt_tls_stats = st;
+    }
+    return bt_tls_stats;
+}
+
+static unsigned long long bt_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Start of an API call: count it and take a timestamp if it is sampled (0 otherwise)
+static unsigned long long bt_op_begin(int op) {
+    bt_stats *st = bt_stats_self();
+    st->cur_op = op;
+    if ((++st->calls[op] & ((1ULL << BT_SAMPLE_SHIFT) - 1)) == 0) return bt_now_ns();
+    return 0;
+}
+
+static void bt_op_end(int op, unsigned long long start) {
+    if (!start) return;
+    unsigned long long ns = bt_now_ns() - start;
+    int b = 0;
+    while (ns > 1 && b < BT_LAT_BUCKETS - 1) {
+        ns >>= 1;
+        b++;
+    }
+    bt_tls_stats->latency[op][b]++;
+}
+
+#define BT_OP_BEGIN(op) unsigned long long bt_op_start_ = bt_op_begin(op)
+#define BT_OP_END(op) bt_op_end(op, bt_op_start_)
+#define BT_STAT_INC(field) (bt_stats_self()->field++)
+#define BT_STAT_VISIT(cmps) do { bt_stats *st_ = bt_stats_self(); \
+        st_->nodes_visited[st_->cur_op]++; st_->key_comparisons[st_->cur_op] += (cmps); } while (0)
+
+// Sum the counters of every thread into out
+void bt_stats_collect(bt_stats *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_mutex_lock(&bt_stats_lock);
+    for (bt_stats *st = bt_stats_head; st; st = st->next) {
+        out->splits += st->splits;
+        out->merges += st->merges;
+        out->borrows_prev += st->borrows_prev;
+        out->borrows_next += st->borrows_next;
+        out->fills += st->fills;
+        for (int op = 0; op < BT_OP_COUNT; ++op) {
+            out->calls[op] += st->calls[op];
+            out->nodes_visited[op] += st->nodes_visited[op];
+            out->key_comparisons[op] += st->key_comparisons[op];
+            for (int b = 0; b < BT_LAT_BUCKETS; ++b)
+                out->latency[op][b] += st->latency[op][b];
+        }
+    }
+    pthread_mutex_unlock(&bt_stats_lock);
+}
+
+// Zero every thread's counters (racy against concurrent updates, meant for quiet points)
+void bt_stats_reset(void) {
+    pthread_mutex_lock(&bt_stats_lock);
+    for (bt_stats *st = bt_stats_head; st; st = st->next) {
+        bt_stats *next = st->next;
+        int cur = st->cur_op;
+        memset(st, 0, sizeof(*st));
+        st->next = next;
+        st->cur_op = cur;
+    }
+    pthread_mutex_unlock(&bt_stats_lock);
+}
+
+// Upper bound in ns of the bucket holding the p-th percentile (0 < p <= 100)
+unsigned long long bt_stats_percentile(const bt_stats *s, int op, double p) {
+    unsigned long long total = 0, seen = 0;
+    for (int b = 0; b < BT_LAT_BUCKETS; ++b) total += s->latency[op][b];
+    if (total == 0) return 0;
+    for (int b = 0; b < BT_LAT_BUCKETS; ++b) {
+        seen += s->latency[op][b];
+        if (seen * 100.0 >= p * total) return 2ULL << b;
+    }
+    return 2ULL << (BT_LAT_BUCKETS - 1);
+}
+
+void bt_stats_print(FILE *out) {
+    static const char *names[BT_OP_COUNT] = {"search", "insert", "remove"};
+    bt_stats s;
+    bt_stats_collect(&s);
+    fprintf(out, "splits=%llu merges=%llu borrows_prev=%llu borrows_next=%llu fills=%llu\n",
+            s.splits, s.merges, s.borrows_prev, s.borrows_next, s.fills);
+    for (int op = 0; op < BT_OP_COUNT; ++op) {
+        if (!s.calls[op]) continue;
+        fprintf(out, "%-6s calls=%llu nodes/op=%.2f cmps/op=%.2f", names[op], s.calls[op],
+                (double)s.nodes_visited[op] / s.calls[op],
+                (double)s.key_comparisons[op] / s.calls[op]);
+        if (bt_stats_percentile(&s, op, 50))
+            fprintf(out, " p50<=%lluns p99<=%lluns p99.9<=%lluns",
+                    bt_stats_percentile(&s, op, 50), bt_stats_percentile(&s, op, 99),
+                    bt_stats_percentile(&s, op, 99.9));
+        fprintf(out, "\n");
+    }
+}
+
+// Periodic dump: a background thread prints the stats every interval_ms
+static pthread_t bt_dumper;
+static atomic_bool bt_dumper_running;
+static FILE *bt_dumper_out;
+static unsigned bt_dumper_ms;
+
+static void *bt_dumper_main(void *arg) {
+    (void)arg;
+    while (atomic_load(&bt_dumper_running)) {
+        usleep(bt_dumper_ms * 1000);
+        if (atomic_load(&bt_dumper_running)) bt_stats_print(bt_dumper_out);
+    }
+    return NULL;
+}
+
+void bt_stats_dump_start(FILE *out, unsigned interval_ms) {
+    if (atomic_load(&bt_dumper_running)) return;
+    bt_dumper_out = out;
+    bt_dumper_ms = interval_ms;
+    atomic_store(&bt_dumper_running, true);
+    pthread_create(&bt_dumper, NULL, bt_dumper_main, NULL);
+}
+
+void bt_stats_dump_stop(void) {
+    if (!atomic_load(&bt_dumper_running)) return;
+    atomic_store(&bt_dumper_running, false);
+    pthread_join(bt_dumper, NULL);
+}
+#else
+#define BT_OP_BEGIN(op)
+#define BT_OP_END(op)
+#define BT_STAT_INC(field) ((void)0)
+#define BT_STAT_VISIT(cmps) ((void)0)
+#endif
+
+// ---- Counted keys ----
+// Plain builds store a repeated key as one more entry, and every API counts it
+// again. Build with -DBT_MULTISET to store each distinct key once, with a count
+// next to it instead. Inserting a key the tree already holds then bumps the
+// count in place, and removing one copy lowers it. Neither shifts keys[] nor
+// splits or merges a node; only the cnt[]/sum[] entries on the path change. A
+// stream with many repeats then costs memory per distinct key. The API behaves
+// the same in both builds: searches, range counts and sums, rank/select, scans
+// and collects all see every copy. The macros below are how the tree code moves
+// keys around: BT_KEY_COPY carries a key's count along with it, and
+// BT_KEY_WEIGHT is the number of copies an entry stands for.
+
+#ifdef BT_MULTISET
+#define BT_COUNTED 1
+#define BT_KEY_WEIGHT(x, i) ((long)(x)->counts[i])
+#define BT_KEY_COPY(dst, di, src, si) \
+    ((dst)->keys[di] = (src)->keys[si], (dst)->counts[di] = (src)->counts[si])
+#define BT_KEY_SET(x, i, k) ((x)->keys[i] = (k), (x)->counts[i] = 1)
+#else
+#define BT_COUNTED 0
+#define BT_KEY_WEIGHT(x, i) 1L
+#define BT_KEY_COPY(dst, di, src, si) ((dst)->keys[di] = (src)->keys[si])
+#define BT_KEY_SET(x, i, k) ((x)->keys[i] = (k))
+#endif
+
+// Bumped whenever nodes split, merge, trade keys with a sibling, change a separator
+// or move in memory. Cached paths into a tree (see bt_finger) are only trusted while
+// the epoch they were recorded in is current.
+static unsigned long bt_epoch;
+
+#define BT_MAX_LEVELS 64 // deepest tree the path caches and statistics track
+
+// ---- Node memory ----
+// Nodes normally come from malloc. bt_compact moves a whole tree into one
+// contiguous arena; nodes inside an arena are recycled through its free list
+// rather than passed to free(), and the arena goes away with its last node.
+// Tree code must therefore release nodes with bt_release_node, never free().
+// Leaves never touch children[], cnt[] or sum[], so a malloc'ed leaf stops short
+// of them: with T=3 that is 32 bytes instead of 176. Arena slots stay full size
+// so any slot can be reused for either kind of node.
+
+#define BT_LEAF_BYTES offsetof(BTreeNode, children)
+
+static size_t bt_node_bytes(const BTreeNode *node) {
+    return node->leaf ? BT_LEAF_BYTES : sizeof(BTreeNode);
+}
+
+typedef struct bt_arena {
+    BTreeNode *base;
+    long cap, live;
+    BTreeNode *free_list;   // released slots, linked through children[0]
+    struct bt_arena *next;
+} bt_arena;
+
+static bt_arena *bt_arenas;
+
+// Reuse a free arena slot so new nodes land next to the compacted ones
+static BTreeNode *bt_arena_take(void) {
+    for (bt_arena *a = bt_arenas; a; a = a->next) {
+        if (a->free_list) {
+            BTreeNode *node = a->free_list;
+            a->free_list = node->children[0];
+            a->live++;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+void bt_release_node(BTreeNode *node) {
+    bt_epoch++; // the address may come back as a different node
+    for (bt_arena **link = &bt_arenas; *link; link = &(*link)->next) {
+        bt_arena *a = *link;
+        if (node >= a->base && node < a->base + a->cap) {
+            node->children[0] = a->free_list;
+            a->free_list = node;
+            if (--a->live == 0) {
+                *link = a->next;
+                free(a->base);
+                free(a);
+            }
+            return;
+        }
+    }
+    free(node);
+}
+
 // Create a new B-Tree node
 BTreeNode *bt_create_node(bool leaf) {
-    BTreeNode *node = (BTreeNode *)malloc(sizeof(BTreeNode));
+    BTreeNode *node = bt_arena_take();
+    if (!node) node = (BTreeNode *)malloc(leaf ? BT_LEAF_BYTES : sizeof(BTreeNode));
     if (!node) {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
     node->leaf = leaf;
     node->n = 0;
-    for (int i = 0; i < 2 * T; ++i) node->children[i] = NULL;
+    for (int i = 0; i < 2 * T && !leaf; ++i) {
+        node->children[i] = NULL;
+        node->cnt[i] = 0;
+        node->sum[i] = 0;
+    }
     return node;
 }
 
+// Recompute the aggregates x keeps for children[i] from that child's keys and
+// its own per-child aggregates. Called for every child that changes on a path.
+void bt_refresh_child(BTreeNode *x, int i) {
+    BTreeNode *c = x->children[i];
+    long cnt = 0;
+    long long sum = 0;
+    for (int j = 0; j < c->n; ++j) {
+        cnt += BT_KEY_WEIGHT(c, j);
+        sum += (long long)c->keys[j] * BT_KEY_WEIGHT(c, j);
+    }
+    if (!c->leaf) {
+        for (int j = 0; j <= c->n; ++j) {
+            cnt += c->cnt[j];
+            sum += c->sum[j];
+        }
+    }
+    x->cnt[i] = cnt;
+    x->sum[i] = sum;
+}
+
 // Search key in subtree rooted with node
 bool bt_search(BTreeNode *node, int k) {
-    if (!node) return false;
-    int i = 0;
-    while (i < node->n && k > node->keys[i]) i++;
-    if (i < node->n && node->keys[i] == k) return true;
-    if (node->leaf) return false;
-    return bt_search(node->children[i], k);
+    bool found = false;
+    BT_OP_BEGIN(BT_OP_SEARCH);
+    while (node) {
+        int i = 0;
+        while (i < node->n && k > node->keys[i]) i++;
+        BT_STAT_VISIT(i + 1);
+        if (i < node->n && node->keys[i] == k) {
+            found = true;
+            break;
+        }
+        if (node->leaf) break;
+        node = node->children[i];
+    }
+    BT_OP_END(BT_OP_SEARCH);
+    return found;
 }
 
-// Split child y of x at index i (y is full)
-void bt_split_child(BTreeNode *x, int i) {
+// Change the count of keys[i] in x by delta, along with the aggregates that
+// path[0..depth) (nodes, and the child taken below each) keep for the subtree
+// holding x. Only counted builds have counts; elsewhere this is never reached.
+static void bt_count_path(BTreeNode **path, const int *idx, int depth, BTreeNode *x, int i, long delta) {
+#ifdef BT_MULTISET
+    x->counts[i] += delta;
+    for (int l = 0; l < depth; ++l) {
+        path[l]->cnt[idx[l]] += delta;
+        path[l]->sum[idx[l]] += delta * x->keys[i];
+    }
+#else
+    (void)path, (void)idx, (void)depth, (void)x, (void)i, (void)delta;
+#endif
+}
+
+// Counted builds: change the count of k by delta if the tree holds k and the
+// count stays positive. Returns false, leaving the tree alone, otherwise (and
+// always in plain builds).
+static bool bt_count_add(BTreeNode *root, int k, long delta) {
+    BTreeNode *path[BT_MAX_LEVELS];
+    int idx[BT_MAX_LEVELS];
+    int depth = 0;
+    BTreeNode *x = root;
+    if (!BT_COUNTED) return false;
+    while (x && depth < BT_MAX_LEVELS) {
+        int i = 0;
+        while (i < x->n && x->keys[i] < k) i++;
+        BT_STAT_VISIT(i + 1);
+        if (i < x->n && x->keys[i] == k) {
+            if (BT_KEY_WEIGHT(x, i) + delta <= 0) return false;
+            bt_count_path(path, idx, depth, x, i, delta);
+            return true;
+        }
+        if (x->leaf) break;
+        path[depth] = x;
+        idx[depth++] = i;
+        x = x->children[i];
+    }
+    return false;
+}
+
+// Split child y of x at index i (y is full); y keeps its first `keep` keys,
+// key[keep] moves up into x and the rest go to the new node z
+void bt_split_child_at(BTreeNode *x, int i, int keep) {
     BTreeNode *y = x->children[i];
     BTreeNode *z = bt_create_node(y->leaf);
-    z->n = T - 1; // z will take last T-1 keys from y
+    BT_STAT_INC(splits);
+    bt_epoch++;
+    z->n = 2 * T - 2 - keep; // z takes the keys after the median
 
-    // copy last T-1 keys of y to z
-    for (int j = 0; j < T - 1; j++)
-        z->keys[j] = y->keys[j + T];
+    // copy the keys after the median from y to z
+    for (int j = 0; j < z->n; j++)
+        BT_KEY_COPY(z, j, y, j + keep + 1);
 
-    // copy last T children of y to z if not leaf
+    // copy the children after the median to z if not leaf
     if (!y->leaf) {
-        for (int j = 0; j < T; j++)
-            z->children[j] = y->children[j + T];
+        for (int j = 0; j <= z->n; j++) {
+            z->children[j] = y->children[j + keep + 1];
+            z->cnt[j] = y->cnt[j + keep + 1];
+            z->sum[j] = y->sum[j + keep + 1];
+        }
     }
 
     // reduce number of keys in y
-    y->n = T - 1;
+    y->n = keep;
 
     // create space in x for new child
-    for (int j = x->n; j >= i + 1; j--)
+    for (int j = x->n; j >= i + 1; j--) {
         x->children[j + 1] = x->children[j];
+        x->cnt[j + 1] = x->cnt[j];
+        x->sum[j + 1] = x->sum[j];
+    }
 
     x->children[i + 1] = z;
 
     // move keys in x to make space for median
     for (int j = x->n - 1; j >= i; j--)
-        x->keys[j + 1] = x->keys[j];
+        BT_KEY_COPY(x, j + 1, x, j);
 
     // put median key of y into x
-    x->keys[i] = y->keys[T - 1];
+    BT_KEY_COPY(x, i, y, keep);
     x->n += 1;
+
+    bt_refresh_child(x, i);
+    bt_refresh_child(x, i + 1);
 }
 
-// Insert when root is not full
-void bt_insert_nonfull(BTreeNode *x, int k) {
+// Split child y of x at index i (y is full) into two halves of T-1 keys
+void bt_split_child(BTreeNode *x, int i) {
+    bt_split_child_at(x, i, T - 1);
+}
+
+// How many keys a full node y keeps when it splits. Append splits leave y nearly
+// full: a leaf keeps 2T-2 keys and the new right leaf starts empty (k goes there
+// at once); an inner node keeps 2T-3 so its new sibling has one separator.
+static int bt_split_keep(const BTreeNode *y, bool append) {
+    if (!append) return T - 1;
+    return y->leaf ? 2 * T - 2 : 2 * T - 3;
+}
+
+// Insert when root is not full. In append mode k is >= every key, so the descent
+// follows the right edge and full nodes there get append splits: the left part
+// stays nearly full and never receives new keys.
+void bt_insert_nonfull_mode(BTreeNode *x, int k, bool append) {
     int i = x->n - 1;
     if (x->leaf) {
         // shift keys to make room
         while (i >= 0 && k < x->keys[i]) {
-            x->keys[i + 1] = x->keys[i];
+            BT_KEY_COPY(x, i + 1, x, i);
             i--;
         }
-        x->keys[i + 1] = k;
+        BT_STAT_VISIT(x->n - i);
+        BT_KEY_SET(x, i + 1, k);
         x->n += 1;
     } else {
         // find child to descend into
         while (i >= 0 && k < x->keys[i]) i--;
+        BT_STAT_VISIT(x->n - i);
         i++;
         if (x->children[i]->n == 2 * T - 1) {
-            bt_split_child(x, i);
-            if (k > x->keys[i]) i++;
+            bt_split_child_at(x, i, bt_split_keep(x->children[i], append));
+            if (append || k > x->keys[i]) i++;
+        }
+        bt_insert_nonfull_mode(x->children[i], k, append);
+        bt_refresh_child(x, i);
+    }
+}
+
+void bt_insert_nonfull(BTreeNode *x, int k) {
+    bt_insert_nonfull_mode(x, k, false);
+}
+
+// ---- Append fast path ----
+// The right edge of the most recently used tree is cached (valid while bt_epoch is
+// unchanged). A key >= the largest key is an append: if the rightmost leaf has room
+// it goes straight there, updating the aggregates of the edge nodes, with no
+// descent. After BT_APPEND_STREAK appends in a row the tree switches to append
+// splits, so monotonic loads fill nodes almost completely.
+
+#define BT_APPEND_STREAK 4
+
+static struct {
+    BTreeNode *root;
+    unsigned long epoch;
+    int depth;
+    BTreeNode *edge[BT_MAX_LEVELS]; // edge[0] = root ... edge[depth-1] = rightmost leaf
+    long streak;                    // consecutive appends seen by bt_insert
+} bt_right;
+
+static BTreeNode *bt_right_leaf(BTreeNode *root) {
+    if (bt_right.root != root || bt_right.epoch != bt_epoch) {
+        bt_right.root = root;
+        bt_right.epoch = bt_epoch;
+        bt_right.depth = 0;
+        for (BTreeNode *x = root; bt_right.depth < BT_MAX_LEVELS; x = x->children[x->n]) {
+            bt_right.edge[bt_right.depth++] = x;
+            if (x->leaf) break;
         }
-        bt_insert_nonfull(x->children[i], k);
     }
+    return bt_right.edge[bt_right.depth - 1];
+}
+
+// Append k to the rightmost leaf if it has room; false if the slow path is needed
+static bool bt_append_fast(BTreeNode *leaf, int k) {
+    if (leaf->n == 2 * T - 1 || !leaf->leaf) return false;
+    BT_KEY_SET(leaf, leaf->n, k);
+    leaf->n++;
+    for (int l = 0; l < bt_right.depth - 1; ++l) {
+        BTreeNode *x = bt_right.edge[l];
+        x->cnt[x->n] += 1;
+        x->sum[x->n] += k;
+    }
+    return true;
 }
 
 // Insert key into B-Tree
 BTreeNode *bt_insert(BTreeNode *root, int k) {
+    BT_OP_BEGIN(BT_OP_INSERT);
     if (!root) {
         root = bt_create_node(true);
-        root->keys[0] = k;
+        BT_KEY_SET(root, 0, k);
         root->n = 1;
-        return root;
-    }
-    if (root->n == 2 * T - 1) {
-        // root is full, need new root
-        BTreeNode *s = bt_create_node(false);
-        s->children[0] = root;
-        bt_split_child(s, 0);
-        int i = (s->keys[0] < k) ? 1 : 0;
-        bt_insert_nonfull(s->children[i], k);
-        return s;
     } else {
-        bt_insert_nonfull(root, k);
-        return root;
+        BTreeNode *leaf = bt_right_leaf(root);
+        bool append = leaf->n > 0 && k >= leaf->keys[leaf->n - 1];
+        bt_right.streak = append ? bt_right.streak + 1 : 0;
+        bool append_split = append && bt_right.streak >= BT_APPEND_STREAK;
+        if (!(append && k > leaf->keys[leaf->n - 1]) && bt_count_add(root, k, 1)) {
+            // counted build, k already there: one more copy, nothing moves
+        } else if (append && bt_append_fast(leaf, k)) {
+            // done: no descent
+        } else if (root->n == 2 * T - 1) {
+            // root is full, need new root
+            BTreeNode *s = bt_create_node(false);
+            s->children[0] = root;
+            bt_split_child_at(s, 0, bt_split_keep(root, append_split));
+            int i = (append_split || s->keys[0] < k) ? 1 : 0;
+            bt_insert_nonfull_mode(s->children[i], k, append_split);
+            bt_refresh_child(s, i);
+            root = s;
+        } else {
+            bt_insert_nonfull_mode(root, k, append_split);
+        }
     }
+    BT_OP_END(BT_OP_INSERT);
+    return root;
 }
 
-// Utility to get predecessor (max key in subtree rooted at node->children[idx])
-int bt_get_predecessor(BTreeNode *node, int idx) {
+// Leaf holding the predecessor of node->keys[idx] (its last key)
+static BTreeNode *bt_predecessor_leaf(BTreeNode *node, int idx) {
     BTreeNode *cur = node->children[idx];
     while (!cur->leaf) cur = cur->children[cur->n];
+    return cur;
+}
+
+// Leaf holding the successor of node->keys[idx] (its first key)
+static BTreeNode *bt_successor_leaf(BTreeNode *node, int idx) {
+    BTreeNode *cur = node->children[idx + 1];
+    while (!cur->leaf) cur = cur->children[0];
+    return cur;
+}
+
+// Utility to get predecessor (max key in subtree rooted at node->children[idx])
+int bt_get_predecessor(BTreeNode *node, int idx) {
+    BTreeNode *cur = bt_predecessor_leaf(node, idx);
     return cur->keys[cur->n - 1];
 }
 
 // Utility to get successor (min key in subtree rooted at node->children[idx+1])
 int bt_get_successor(BTreeNode *node, int idx) {
-    BTreeNode *cur = node->children[idx + 1];
-    while (!cur->leaf) cur = cur->children[0];
-    return cur->keys[0];
+    return bt_successor_leaf(node, idx)->keys[0];
 }
 
 // Merge children idx and idx+1 of node. Pull down key[idx] into merged child.
 void bt_merge(BTreeNode *node, int idx) {
     BTreeNode *child = node->children[idx];
     BTreeNode *sibling = node->children[idx + 1];
+    BT_STAT_INC(merges);
+    bt_epoch++;
 
-    // pull key from node down to child
-    child->keys[T - 1] = node->keys[idx];
+    // pull key from node down to child (child may hold fewer than T-1 keys
+    // after an append split, so place everything after its last key)
+    int base = child->n + 1;
+    BT_KEY_COPY(child, child->n, node, idx);
 
     // copy keys from sibling to child
     for (int i = 0; i < sibling->n; ++i)
-        child->keys[i + T] = sibling->keys[i];
+        BT_KEY_COPY(child, i + base, sibling, i);
 
     // copy children as well
     if (!child->leaf) {
-        for (int i = 0; i <= sibling->n; ++i)
-            child->children[i + T] = sibling->children[i];
+        for (int i = 0; i <= sibling->n; ++i) {
+            child->children[i + base] = sibling->children[i];
+            child->cnt[i + base] = sibling->cnt[i];
+            child->sum[i + base] = sibling->sum[i];
+        }
     }
 
     child->n += sibling->n + 1;
 
     // shift keys and children in node
     for (int i = idx + 1; i < node->n; ++i)
-        node->keys[i - 1] = node->keys[i];
-    for (int i = idx + 2; i <= node->n; ++i)
+        BT_KEY_COPY(node, i - 1, node, i);
+    for (int i = idx + 2; i <= node->n; ++i) {
         node->children[i - 1] = node->children[i];
+        node->cnt[i - 1] = node->cnt[i];
+        node->sum[i - 1] = node->sum[i];
+    }
 
     node->n--;
+    bt_refresh_child(node, idx);
 
-    free(sibling);
+    bt_release_node(sibling);
 }
 
 // Borrow from previous sibling
 void bt_borrow_from_prev(BTreeNode *node, int idx) {
     BTreeNode *child = node->children[idx];
     BTreeNode *sibling = node->children[idx - 1];
+    BT_STAT_INC(borrows_prev);
+    bt_epoch++;
 
     // shift child's keys and children right by 1
     for (int i = child->n - 1; i >= 0; --i)
-        child->keys[i + 1] = child->keys[i];
+        BT_KEY_COPY(child, i + 1, child, i);
 
     if (!child->leaf) {
-        for (int i = child->n; i >= 0; --i)
+        for (int i = child->n; i >= 0; --i) {
             child->children[i + 1] = child->children[i];
+            child->cnt[i + 1] = child->cnt[i];
+            child->sum[i + 1] = child->sum[i];
+        }
     }
 
     // put key from node down to child
-    child->keys[0] = node->keys[idx - 1];
+    BT_KEY_COPY(child, 0, node, idx - 1);
 
-    if (!child->leaf)
+    if (!child->leaf) {
         child->children[0] = sibling->children[sibling->n];
+        child->cnt[0] = sibling->cnt[sibling->n];
+        child->sum[0] = sibling->sum[sibling->n];
+    }
 
     // move sibling's last key up to node
-    node->keys[idx - 1] = sibling->keys[sibling->n - 1];
+    BT_KEY_COPY(node, idx - 1, sibling, sibling->n - 1);
 
     child->n += 1;
     sibling->n -= 1;
+
+    bt_refresh_child(node, idx - 1);
+    bt_refresh_child(node, idx);
 }
 
 // Borrow from next sibling
 void bt_borrow_from_next(BTreeNode *node, int idx) {
     BTreeNode *child = node->children[idx];
     BTreeNode *sibling = node->children[idx + 1];
+    BT_STAT_INC(borrows_next);
+    bt_epoch++;
 
     // node's key moves to child's last key
-    child->keys[child->n] = node->keys[idx];
+    BT_KEY_COPY(child, child->n, node, idx);
 
-    if (!child->leaf)
+    if (!child->leaf) {
         child->children[child->n + 1] = sibling->children[0];
+        child->cnt[child->n + 1] = sibling->cnt[0];
+        child->sum[child->n + 1] = sibling->sum[0];
+    }
 
     // sibling's first key moves up to node
-    node->keys[idx] = sibling->keys[0];
+    BT_KEY_COPY(node, idx, sibling, 0);
 
     // shift keys and children in sibling left by 1
     for (int i = 1; i < sibling->n; ++i)
-        sibling->keys[i - 1] = sibling->keys[i];
+        BT_KEY_COPY(sibling, i - 1, sibling, i);
     if (!sibling->leaf) {
-        for (int i = 1; i <= sibling->n; ++i)
+        for (int i = 1; i <= sibling->n; ++i) {
             sibling->children[i - 1] = sibling->children[i];
+            sibling->cnt[i - 1] = sibling->cnt[i];
+            sibling->sum[i - 1] = sibling->sum[i];
+        }
     }
 
     child->n += 1;
     sibling->n -= 1;
+
+    bt_refresh_child(node, idx);
+    bt_refresh_child(node, idx + 1);
 }
 
 // Ensure child idx has at least T-1 keys
 void bt_fill(BTreeNode *node, int idx) {
+    BT_STAT_INC(fills);
     if (idx != 0 && node->children[idx - 1]->n >= T)
         bt_borrow_from_prev(node, idx);
     else if (idx != node->n && node->children[idx + 1]->n >= T)
@@ -233,34 +723,41 @@ void bt_remove_from_node(BTreeNode *node, int k);
 // Remove key present in leaf node at idx
 void bt_remove_from_leaf(BTreeNode *node, int idx) {
     for (int i = idx + 1; i < node->n; ++i)
-        node->keys[i - 1] = node->keys[i];
+        BT_KEY_COPY(node, i - 1, node, i);
     node->n--;
 }
 
 // Remove key present in non-leaf node at idx
 void bt_remove_from_nonleaf(BTreeNode *node, int idx) {
     int k = node->keys[idx];
+    bt_epoch++; // the separator at idx is replaced
     // If the child before idx has at least T keys, find predecessor
     if (node->children[idx]->n >= T) {
-        int pred = bt_get_predecessor(node, idx);
-        node->keys[idx] = pred;
+        BTreeNode *leaf = bt_predecessor_leaf(node, idx);
+        int pred = leaf->keys[leaf->n - 1];
+        BT_KEY_COPY(node, idx, leaf, leaf->n - 1);
         bt_remove_from_node(node->children[idx], pred);
+        bt_refresh_child(node, idx);
     }
     // Else if child after idx has at least T keys, find successor
     else if (node->children[idx + 1]->n >= T) {
-        int succ = bt_get_successor(node, idx);
-        node->keys[idx] = succ;
+        BTreeNode *leaf = bt_successor_leaf(node, idx);
+        int succ = leaf->keys[0];
+        BT_KEY_COPY(node, idx, leaf, 0);
         bt_remove_from_node(node->children[idx + 1], succ);
+        bt_refresh_child(node, idx + 1);
     } else {
         // Merge children and then remove k from merged child
         bt_merge(node, idx);
         bt_remove_from_node(node->children[idx], k);
+        bt_refresh_child(node, idx);
     }
 }
 
 void bt_remove_from_node(BTreeNode *node, int k) {
     int idx = 0;
     while (idx < node->n && node->keys[idx] < k) idx++;
+    BT_STAT_VISIT(idx + 1);
 
     if (idx < node->n && node->keys[idx] == k) {
         if (node->leaf)
@@ -275,100 +772,2000 @@ void bt_remove_from_node(BTreeNode *node, int k) {
             bt_fill(node, idx);
 
         if (flag && idx > node->n)
-            bt_remove_from_node(node->children[idx - 1], k);
-        else
-            bt_remove_from_node(node->children[idx], k);
+            idx--;
+        bt_remove_from_node(node->children[idx], k);
+        bt_refresh_child(node, idx);
     }
 }
 
 // Remove key from B-Tree; adjust root if necessary
 BTreeNode *bt_remove(BTreeNode *root, int k) {
     if (!root) return NULL;
-    bt_remove_from_node(root, k);
-    if (root->n == 0) {
-        BTreeNode *tmp = root;
-        if (root->leaf) {
-            free(root);
-            root = NULL;
-        } else {
-            root = root->children[0];
-            free(tmp);
+    BT_OP_BEGIN(BT_OP_REMOVE);
+    if (bt_count_add(root, k, -1)) {
+        // counted build: one copy fewer, the entry stays
+    } else {
+        bt_remove_from_node(root, k);
+        if (root->n == 0) {
+            BTreeNode *tmp = root;
+            if (root->leaf) {
+                bt_release_node(root);
+                root = NULL;
+            } else {
+                root = root->children[0];
+                bt_release_node(tmp);
+            }
         }
     }
+    BT_OP_END(BT_OP_REMOVE);
     return root;
 }
 
-// Print tree structure (preorder) with indentation
-void bt_print(BTreeNode *root, int level) {
-    if (!root) return;
-    for (int i = 0; i < level; ++i) printf("  ");
-    printf("[");
-    for (int i = 0; i < root->n; ++i) {
-        printf("%d", root->keys[i]);
-        if (i + 1 < root->n) printf(" ");
+// ---- Relaxed deletion ----
+// bt_remove fills every child below T keys on its way down, even when k turns out
+// to be absent. bt_remove_relaxed looks k up first and restructures only after a
+// key is really gone, and then only around nodes that became empty: nodes may hold
+// any number of keys (free-at-empty). bt_remove still works on such trees because
+// it refills every child with fewer than T keys before entering it.
+
+// Child i of x has no keys left: merge it into a sibling, or take one key from a
+// full sibling. An empty inner node still has its one child, which moves along.
+static void bt_fix_empty(BTreeNode *x, int i) {
+    if (i > 0) {
+        if (x->children[i - 1]->n < 2 * T - 1) bt_merge(x, i - 1);
+        else bt_borrow_from_prev(x, i);
+    } else {
+        if (x->children[1]->n < 2 * T - 1) bt_merge(x, 0);
+        else bt_borrow_from_next(x, 0);
     }
-    printf("]\n");
-    if (!root->leaf) {
-        for (int i = 0; i <= root->n; ++i)
-            bt_print(root->children[i], level + 1);
+}
+
+BTreeNode *bt_remove_relaxed(BTreeNode *root, int k) {
+    BTreeNode *path[BT_MAX_LEVELS];
+    int idx[BT_MAX_LEVELS];
+    int depth = 0;
+    if (!root) return NULL;
+    BT_OP_BEGIN(BT_OP_REMOVE);
+    BTreeNode *x = root;
+    int i;
+    for (;;) {
+        i = 0;
+        while (i < x->n && x->keys[i] < k) i++;
+        BT_STAT_VISIT(i + 1);
+        if ((i < x->n && x->keys[i] == k) || x->leaf) break;
+        path[depth] = x;
+        idx[depth++] = i;
+        x = x->children[i];
+    }
+    if (i < x->n && x->keys[i] == k && BT_KEY_WEIGHT(x, i) > 1) {
+        bt_count_path(path, idx, depth, x, i, -1); // counted build: the entry stays
+    } else if (i < x->n && x->keys[i] == k) {
+        if (x->leaf) {
+            bt_remove_from_leaf(x, i);
+        } else {
+            // k is replaced by its predecessor, which leaves the predecessor's leaf
+            bt_epoch++;
+            path[depth] = x;
+            idx[depth++] = i;
+            BTreeNode *leaf = x->children[i];
+            while (!leaf->leaf) {
+                path[depth] = leaf;
+                idx[depth++] = leaf->n;
+                leaf = leaf->children[leaf->n];
+            }
+            BT_KEY_COPY(x, i, leaf, leaf->n - 1);
+            leaf->n--;
+        }
+        // back up the path: refresh the aggregates and dissolve empty nodes
+        for (int l = depth - 1; l >= 0; --l) {
+            if (path[l]->children[idx[l]]->n == 0)
+                bt_fix_empty(path[l], idx[l]);
+            else
+                bt_refresh_child(path[l], idx[l]);
+        }
+        if (root->n == 0) {
+            BTreeNode *tmp = root;
+            root = root->leaf ? NULL : root->children[0];
+            bt_release_node(tmp);
+        }
     }
+    BT_OP_END(BT_OP_REMOVE);
+    return root;
 }
 
-// Utility: generate N unique random numbers in range [0..maxv)
-void gen_unique_randoms(int *arr, int N, int maxv) {
-    if (N > maxv) {
-        fprintf(stderr, "Not enough unique values available\n");
-        exit(EXIT_FAILURE);
+// ---- Range aggregates ----
+// Every node keeps the key count and key sum of each child's subtree, so the
+// queries below walk a single root-to-leaf path and touch O(height) nodes.
+
+// Count and sum of keys < k (or <= k when inclusive)
+void bt_prefix(BTreeNode *node, int k, bool inclusive, long *cnt, long long *sum) {
+    *cnt = 0;
+    *sum = 0;
+    while (node) {
+        int i = 0;
+        while (i < node->n && (inclusive ? node->keys[i] <= k : node->keys[i] < k)) {
+            *cnt += BT_KEY_WEIGHT(node, i);
+            *sum += (long long)node->keys[i] * BT_KEY_WEIGHT(node, i);
+            if (!node->leaf) {
+                *cnt += node->cnt[i];
+                *sum += node->sum[i];
+            }
+            i++;
+        }
+        node = node->leaf ? NULL : node->children[i];
     }
-    // simple reservoir-like / shuffle approach
-    int *pool = malloc(sizeof(int) * maxv);
-    for (int i = 0; i < maxv; ++i) pool[i] = i + 1; // 1..maxv
-    // Fisher-Yates shuffle first N positions
-    for (int i = 0; i < N; ++i) {
-        int j = i + rand() % (maxv - i);
-        int tmp = pool[i]; pool[i] = pool[j]; pool[j] = tmp;
-        arr[i] = pool[i];
+}
+
+// Number of keys in the tree, read off the root's per-child counts
+long bt_size(BTreeNode *root) {
+    if (!root) return 0;
+    long n = 0;
+    for (int i = 0; i < root->n; ++i) n += BT_KEY_WEIGHT(root, i);
+    if (!root->leaf)
+        for (int i = 0; i <= root->n; ++i) n += root->cnt[i];
+    return n;
+}
+
+// Number of keys in [lo, hi]
+long bt_range_count(BTreeNode *root, int lo, int hi) {
+    long a, b;
+    long long sa, sb;
+    if (lo > hi) return 0;
+    bt_prefix(root, lo, false, &a, &sa);
+    bt_prefix(root, hi, true, &b, &sb);
+    return b - a;
+}
+
+// Sum of keys in [lo, hi]
+long long bt_range_sum(BTreeNode *root, int lo, int hi) {
+    long a, b;
+    long long sa, sb;
+    if (lo > hi) return 0;
+    bt_prefix(root, lo, false, &a, &sa);
+    bt_prefix(root, hi, true, &b, &sb);
+    return sb - sa;
+}
+
+// Number of keys strictly smaller than k
+long bt_rank(BTreeNode *root, int k) {
+    long cnt;
+    long long sum;
+    bt_prefix(root, k, false, &cnt, &sum);
+    return cnt;
+}
+
+// r-th smallest key (0-based); returns false when r is out of range
+bool bt_select(BTreeNode *node, long r, int *out) {
+    if (r < 0) return false;
+    while (node) {
+        int i = 0;
+        for (; i < node->n; ++i) {
+            long below = node->leaf ? 0 : node->cnt[i];
+            if (r < below) break;
+            r -= below;
+            if (r < BT_KEY_WEIGHT(node, i)) {
+                *out = node->keys[i];
+                return true;
+            }
+            r -= BT_KEY_WEIGHT(node, i);
+        }
+        node = node->leaf ? NULL : node->children[i];
     }
-    free(pool);
+    return false;
 }
 
-int main(void) {
-    srand((unsigned)time(NULL));
+// Smallest and largest key in [lo, hi]; return false when the range is empty
+bool bt_range_min(BTreeNode *root, int lo, int hi, int *out) {
+    if (bt_range_count(root, lo, hi) == 0) return false;
+    return bt_select(root, bt_rank(root, lo), out);
+}
 
-    // prepare 100 unique random elements
-    const int N = 100;
-    int arr[N];
-    gen_unique_randoms(arr, N, 1000); // choose unique numbers from 1..1000
+bool bt_range_max(BTreeNode *root, int lo, int hi, int *out) {
+    long cnt;
+    long long sum;
+    if (bt_range_count(root, lo, hi) == 0) return false;
+    bt_prefix(root, hi, true, &cnt, &sum);
+    return bt_select(root, cnt - 1, out);
+}
 
-    BTreeNode *root = NULL;
+// ---- Range delete ----
+// bt_remove_range cuts [lo, hi] out of the tree in one pass. Children lying wholly
+// inside the range are freed as whole subtrees; only the (at most two) boundary
+// paths are descended and edited. Where the paths fork, one key of the range is
+// kept as a separator until the end. Nodes left empty are then dissolved the way
+// bt_remove_relaxed does it, so the cost is O(height + freed nodes).
 
-    printf("Inserting 100 random keys into B-Tree (T=%d)...\n", T);
-    for (int i = 0; i < N; ++i) {
-        root = bt_insert(root, arr[i]);
+void bt_free(BTreeNode *root);
+
+static bool bt_has_empty_child(const BTreeNode *x) {
+    if (x->leaf) return false;
+    for (int j = 0; j <= x->n; ++j)
+        if (x->children[j]->n == 0) return true;
+    return false;
+}
+
+// Dissolve empty nodes below x. A merged empty inner node brings its single child
+// along, which may be empty in turn, so the repair follows it down; a repair down
+// there can use up a child's only key, so x is checked again afterwards.
+static void bt_repair_empty(BTreeNode *x) {
+    for (;;) {
+        while (x->n > 0 && bt_has_empty_child(x)) {
+            int j = 0;
+            while (x->children[j]->n != 0) j++;
+            bt_fix_empty(x, j);
+        }
+        if (x->leaf) return;
+        for (int j = 0; j <= x->n; ++j)
+            if (bt_has_empty_child(x->children[j])) bt_repair_empty(x->children[j]);
+        if (x->n == 0 || !bt_has_empty_child(x)) return;
     }
+}
 
-    printf("\nB-Tree structure after inserts:\n");
-    bt_print(root, 0);
+// Remove the keys in [lo, hi] under x. above_lo / below_hi say that every key under
+// x is already known to be >= lo / <= hi. A kept separator is reported in *sep.
+static void bt_cut(BTreeNode *x, int lo, int hi, bool above_lo, bool below_hi,
+                   bool *has_sep, int *sep) {
+    int i0 = 0, i1 = x->n;
+    if (!above_lo)
+        while (i0 < x->n && x->keys[i0] < lo) i0++;
+    if (!below_hi) {
+        i1 = i0;
+        while (i1 < x->n && x->keys[i1] <= hi) i1++;
+    }
+    if (x->leaf) {
+        for (int j = i1; j < x->n; ++j) BT_KEY_COPY(x, j - (i1 - i0), x, j);
+        x->n -= i1 - i0;
+        return;
+    }
+    // children i0..i1 meet the range; the outer two only in part unless a bound
+    // is already known to hold for them
+    bool left_part = i0 == i1 || !above_lo;
+    bool right_part = i0 < i1 && !below_hi;
+    BTreeNode *left = x->children[i0], *right = x->children[i1];
+    for (int j = i0; j <= i1; ++j) {
+        if ((j == i0 && left_part) || (j == i1 && right_part)) continue;
+        bt_free(x->children[j]);
+    }
+    // keep key i0 between the two partial children, drop the other range keys
+    int keep = (left_part && right_part) ? 1 : 0;
+    int drop = i1 - i0 - keep;
+    if (keep) {
+        *has_sep = true;
+        *sep = x->keys[i0];
+    }
+    int at = i0; // next free child slot
+    if (left_part) {
+        x->children[at] = left;
+        x->cnt[at] = x->cnt[i0];
+        x->sum[at] = x->sum[i0];
+        at++;
+    }
+    if (right_part) {
+        x->children[at] = right;
+        x->cnt[at] = x->cnt[i1];
+        x->sum[at] = x->sum[i1];
+        at++;
+    }
+    for (int j = i1 + 1; j <= x->n; ++j, ++at) {
+        x->children[at] = x->children[j];
+        x->cnt[at] = x->cnt[j];
+        x->sum[at] = x->sum[j];
+    }
+    for (int j = i0 + keep; j + drop < x->n; ++j) BT_KEY_COPY(x, j, x, j + drop);
+    x->n -= drop;
 
-    // Demonstrate search
-    printf("\nSearch demo:\n");
-    int to_search[5] = {arr[0], arr[10], arr[20], 9999, arr[99]}; // include a not-present value 9999
-    for (int i = 0; i < 5; ++i) {
-        int k = to_search[i];
-        printf("Searching %d -> %s\n", k, bt_search(root, k) ? "FOUND" : "NOT FOUND");
+    if (left_part) {
+        bt_cut(x->children[i0], lo, hi, above_lo, below_hi || i0 < i1, has_sep, sep);
+        bt_refresh_child(x, i0);
     }
+    if (right_part) {
+        int r = i0 + (left_part ? 1 : 0);
+        bt_cut(x->children[r], lo, hi, true, below_hi, has_sep, sep);
+        bt_refresh_child(x, r);
+    }
+    bt_repair_empty(x);
+}
 
-    // Demonstrate deletions: remove 10 keys (first 10 inserted)
-    printf("\nDeleting 10 keys (first 10 inserted):\n");
-    for (int i = 0; i < 10; ++i) {
-        int key = arr[i];
-        printf("Deleting %d\n", key);
-        root = bt_remove(root, key);
+// Remove every key in [lo, hi]; returns the new root
+BTreeNode *bt_remove_range(BTreeNode *root, int lo, int hi) {
+    bool has_sep = false;
+    int sep = 0;
+    if (!root || lo > hi) return root;
+    bt_epoch++;
+    bt_cut(root, lo, hi, false, false, &has_sep, &sep);
+    while (root && root->n == 0) {
+        BTreeNode *tmp = root;
+        root = root->leaf ? NULL : root->children[0];
+        bt_release_node(tmp);
+    }
+    if (has_sep) {
+        // a counted separator goes down to one copy so the entry itself is removed
+        if (BT_COUNTED) bt_count_add(root, sep, 1 - bt_range_count(root, sep, sep));
+        root = bt_remove_relaxed(root, sep);
     }
+    return root;
+}
 
-    printf("\nB-Tree structure after deletions:\n");
-    bt_print(root, 0);
+// ---- Tombstones ----
+// bt_tomb_delete only records the delete; the tree is left alone until
+// bt_tomb_cleanup applies the pending deletes in key order through
+// bt_remove_relaxed, e.g. from an idle loop. A full buffer drains its smallest
+// quarter first. bt_tomb_search sees the deletes at once; the range aggregates
+// see them after the cleanup.
+
+#define BT_TOMB_CAP 256 // pending deletes per buffer
+
+typedef struct bt_tombs {
+    int key[BT_TOMB_CAP]; // ascending; a key repeats once per pending delete
+    int n;
+} bt_tombs;
+
+void bt_tombs_init(bt_tombs *t) {
+    t->n = 0;
+}
+
+// Pending deletes of k; *at receives the first slot holding a key >= k
+static int bt_tomb_count(const bt_tombs *t, int k, int *at) {
+    int lo = 0, hi = t->n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (t->key[mid] < k) lo = mid + 1;
+        else hi = mid;
+    }
+    *at = lo;
+    int c = 0;
+    while (lo + c < t->n && t->key[lo + c] == k) c++;
+    return c;
+}
+
+// Does the tree hold a copy of k that no pending delete accounts for?
+bool bt_tomb_search(const bt_tombs *t, BTreeNode *root, int k) {
+    int at;
+    int pending = bt_tomb_count(t, k, &at);
+    if (pending == 0) return bt_search(root, k);
+    return bt_range_count(root, k, k) > pending;
+}
+
+// Apply up to budget pending deletes, smallest keys first (budget <= 0: all)
+BTreeNode *bt_tomb_cleanup(bt_tombs *t, BTreeNode *root, int budget) {
+    int m = (budget <= 0 || budget > t->n) ? t->n : budget;
+    for (int i = 0; i < m; ++i) root = bt_remove_relaxed(root, t->key[i]);
+    memmove(t->key, t->key + m, sizeof(int) * (t->n - m));
+    t->n -= m;
+    return root;
+}
+
+// Delete one copy of k lazily; absent keys are ignored
+BTreeNode *bt_tomb_delete(bt_tombs *t, BTreeNode *root, int k) {
+    int at;
+    if (!bt_tomb_search(t, root, k)) return root;
+    if (t->n == BT_TOMB_CAP) root = bt_tomb_cleanup(t, root, BT_TOMB_CAP / 4);
+    bt_tomb_count(t, k, &at);
+    memmove(t->key + at + 1, t->key + at, sizeof(int) * (t->n - at));
+    t->key[at] = k;
+    t->n++;
+    return root;
+}
+
+// ---- Miss filter ----
+// A counting Bloom filter in front of the tree. Keys added through
+// bt_filter_insert bump a few 8-bit counters, all in one 64-byte block picked by
+// the key's hash, so a lookup costs one cache miss. A lookup finding any of them
+// at zero is a definite miss and never touches the tree. bt_filter_remove
+// decrements them again; a counter that reached 255 stays there, which can only
+// cost false positives. Keys added or removed behind the filter's back (bulk
+// deletes, plain bt_insert) need a bt_filter_rebuild.
+// Memory is counters_per_key bytes per expected key. About 10 counters and 7
+// hashes per key give about 2% false positives (blocking costs a little accuracy).
+
+#define BT_FILTER_COUNTERS_PER_KEY 10
+#define BT_FILTER_HASHES 7
+#define BT_FILTER_MAX_HASHES 10 // 6 hash bits per probe, 60 bits in all
+
+typedef struct bt_filter {
+    unsigned char *counters; // nblocks blocks of 64 counters, cache-line aligned
+    size_t nblocks;
+    int hashes;
+    long skipped;   // lookups answered by the filter alone
+    long false_pos; // lookups that passed the filter and missed in the tree
+} bt_filter;
+
+static unsigned long long bt_mix64(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+void bt_filter_init(bt_filter *f, long expected_keys, int counters_per_key, int hashes) {
+    size_t bytes = (size_t)(expected_keys > 0 ? expected_keys : 1) * (counters_per_key > 0 ? counters_per_key : 1);
+    void *mem;
+    f->nblocks = (bytes + 63) / 64;
+    f->hashes = hashes < 1 ? 1 : hashes > BT_FILTER_MAX_HASHES ? BT_FILTER_MAX_HASHES : hashes;
+    f->skipped = f->false_pos = 0;
+    if (posix_memalign(&mem, 64, f->nblocks * 64) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    f->counters = (unsigned char *)mem;
+    memset(f->counters, 0, f->nblocks * 64);
+}
+
+void bt_filter_free(bt_filter *f) {
+    free(f->counters);
+    f->counters = NULL;
+}
+
+// The block for k and the counter offsets inside it
+static unsigned char *bt_filter_block(const bt_filter *f, int k, unsigned long long *bits) {
+    unsigned long long h = bt_mix64((unsigned)k);
+    *bits = bt_mix64(h);
+    return f->counters + 64 * (size_t)(((h >> 32) * f->nblocks) >> 32);
+}
+
+static void bt_filter_add(bt_filter *f, int k, int delta) {
+    unsigned long long bits;
+    unsigned char *block = bt_filter_block(f, k, &bits);
+    for (int i = 0; i < f->hashes; ++i, bits >>= 6) {
+        unsigned char *c = &block[bits & 63];
+        if (*c == 255) continue; // saturated: the true count is unknown now
+        *c += delta;
+    }
+}
+
+static bool bt_filter_maybe(const bt_filter *f, int k) {
+    unsigned long long bits;
+    const unsigned char *block = bt_filter_block(f, k, &bits);
+    for (int i = 0; i < f->hashes; ++i, bits >>= 6)
+        if (block[bits & 63] == 0) return false;
+    return true;
+}
+
+BTreeNode *bt_filter_insert(bt_filter *f, BTreeNode *root, int k) {
+    bt_filter_add(f, k, 1);
+    return bt_insert(root, k);
+}
+
+// Counters only go down when a key was really removed
+BTreeNode *bt_filter_remove(bt_filter *f, BTreeNode *root, int k) {
+    if (!bt_filter_maybe(f, k)) return root;
+    long before = bt_size(root);
+    root = bt_remove(root, k);
+    if (bt_size(root) < before) bt_filter_add(f, k, -1);
+    return root;
+}
+
+bool bt_filter_search(bt_filter *f, BTreeNode *root, int k) {
+    if (!bt_filter_maybe(f, k)) {
+        f->skipped++;
+        return false;
+    }
+    bool found = bt_search(root, k);
+    if (!found) f->false_pos++;
+    return found;
+}
+
+// Misses that still had to descend the tree, as a share of all misses seen
+double bt_filter_fp_rate(const bt_filter *f) {
+    long misses = f->skipped + f->false_pos;
+    return misses ? (double)f->false_pos / misses : 0.0;
+}
+
+static void bt_filter_add_tree(bt_filter *f, BTreeNode *node) {
+    for (int i = 0; i < node->n; ++i) {
+        // one add per copy; past 255 the counters are saturated anyway
+        long copies = BT_KEY_WEIGHT(node, i) < 255 ? BT_KEY_WEIGHT(node, i) : 255;
+        for (long c = 0; c < copies; ++c) bt_filter_add(f, node->keys[i], 1);
+    }
+    if (!node->leaf)
+        for (int i = 0; i <= node->n; ++i) bt_filter_add_tree(f, node->children[i]);
+}
+
+// Recount every counter from the keys in the tree
+void bt_filter_rebuild(bt_filter *f, BTreeNode *root) {
+    memset(f->counters, 0, f->nblocks * 64);
+    if (root) bt_filter_add_tree(f, root);
+}
+
+// ---- Hot-key cache ----
+// A direct-mapped cache of recent lookup results in front of bt_search, for
+// skewed workloads where a few thousand keys take most of the lookups. Each slot
+// remembers one key and whether the tree holds it. bt_cache_insert and
+// bt_cache_remove keep the key they touch exact; other changes to the tree
+// (range deletes, tombstone cleanup, ...) must be followed by bt_cache_clear.
+
+#define BT_CACHE_SLOTS 16384 // default size (128 KiB); any power of two works
+
+enum { BT_CACHE_EMPTY, BT_CACHE_PRESENT, BT_CACHE_ABSENT };
+
+typedef struct bt_cache_slot {
+    int key;
+    int state; // BT_CACHE_*
+} bt_cache_slot;
+
+typedef struct bt_cache {
+    bt_cache_slot *slots;
+    unsigned mask;   // slot count - 1
+    long hits, misses;
+} bt_cache;
+
+// slots is rounded up to a power of two
+void bt_cache_init(bt_cache *c, unsigned slots) {
+    unsigned n = 1;
+    while (n < slots) n <<= 1;
+    c->slots = (bt_cache_slot *)calloc(n, sizeof(bt_cache_slot));
+    if (!c->slots) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    c->mask = n - 1;
+    c->hits = c->misses = 0;
+}
+
+void bt_cache_free(bt_cache *c) {
+    free(c->slots);
+    c->slots = NULL;
+}
+
+void bt_cache_clear(bt_cache *c) {
+    memset(c->slots, 0, sizeof(bt_cache_slot) * (c->mask + 1));
+}
+
+static bt_cache_slot *bt_cache_slot_of(const bt_cache *c, int k) {
+    return &c->slots[(unsigned)bt_mix64((unsigned)k) & c->mask];
+}
+
+bool bt_cache_search(bt_cache *c, BTreeNode *root, int k) {
+    bt_cache_slot *s = bt_cache_slot_of(c, k);
+    if (s->state != BT_CACHE_EMPTY && s->key == k) {
+        c->hits++;
+        return s->state == BT_CACHE_PRESENT;
+    }
+    c->misses++;
+    bool found = bt_search(root, k);
+    s->key = k;
+    s->state = found ? BT_CACHE_PRESENT : BT_CACHE_ABSENT;
+    return found;
+}
+
+BTreeNode *bt_cache_insert(bt_cache *c, BTreeNode *root, int k) {
+    bt_cache_slot *s = bt_cache_slot_of(c, k);
+    if (s->key == k) s->state = BT_CACHE_PRESENT;
+    return bt_insert(root, k);
+}
+
+// Another copy of k may remain, so a cached entry for k is dropped, not flipped
+BTreeNode *bt_cache_remove(bt_cache *c, BTreeNode *root, int k) {
+    bt_cache_slot *s = bt_cache_slot_of(c, k);
+    if (s->key == k) s->state = BT_CACHE_EMPTY;
+    return bt_remove(root, k);
+}
+
+double bt_cache_hit_rate(const bt_cache *c) {
+    long total = c->hits + c->misses;
+    return total ? (double)c->hits / total : 0.0;
+}
+
+// ---- Radix directory ----
+// For integer keys a flat directory can stand in for the top levels of the tree:
+// the high bits of a key pick one of 2^bits independent subtrees, so every lookup
+// starts a few levels down. The slots cover consecutive key intervals in order,
+// so a range query reads partial slots at both ends and takes the slots in
+// between whole from their roots' aggregates. bt_dir_init chooses the span and the
+// number of bits from a sample of the keys; keys outside the sampled span go to
+// the first or last slot.
+//
+// Each slot covers an aligned interval of 2^shift values, like a Roaring
+// container. When a slot's keys fill a large enough share of its interval,
+// the subtree is replaced by a bitmap with one bit per value. A bitmap key
+// costs one bit instead of a share of a node. Membership is a bit test, counts
+// are popcounts and scans walk the set bits. A slot becomes a bitmap when its
+// subtree grows to 1/BT_DIR_DENSE of the interval. It goes back to a subtree,
+// built with bt_build, when it drops below 1/BT_DIR_SPARSE. The gap between the
+// two keeps a slot from flipping back and forth.
+//
+// A bitmap holds each value once and only values of its own interval. A subtree
+// with duplicates, or with keys clamped in from outside the span, stays a
+// subtree. Inserting such a key into a bitmap slot turns the slot back into a
+// subtree first. The switch to a bitmap is tried after inserts and removes that
+// leave a subtree at or above the threshold size. A slot that could not switch
+// remembers the key that stopped it. It is tried again when that key is removed
+// or once its size has moved by 1/BT_DIR_RETRY, so it is not rescanned on every
+// update.
+
+#define BT_DIR_KEYS_PER_SLOT 64 // target subtree size, about three levels at T=3
+#define BT_DIR_MAX_BITS 20
+#define BT_DIR_BITMAP_MAX_SHIFT 16 // bitmaps cover at most 2^16 values (8 KB)
+#define BT_DIR_DENSE 32  // subtree -> bitmap at 1/32 of the slot's values
+#define BT_DIR_SPARSE 64 // bitmap -> subtree below 1/64
+#define BT_DIR_RETRY 8   // retry a failed switch after the size moves by 1/8
+
+BTreeNode *bt_build(int *keys, long n, wp_pool *pool);
+long bt_range_collect(BTreeNode *root, int lo, int hi, int *out, wp_pool *pool);
+
+typedef struct bt_dir_bitmap {
+    long ones;      // keys in the slot
+    long long sum;  // their sum, so whole slots are summed in O(1)
+    unsigned long long words[];
+} bt_dir_bitmap;
+
+typedef struct bt_dir_miss {
+    long size;  // subtree size at the failed attempt, 0 if there was none
+    int key;    // a duplicate or stray key that ruled out the bitmap
+} bt_dir_miss;
+
+typedef struct bt_dir {
+    BTreeNode **slot;
+    bt_dir_bitmap **bitmap; // non-NULL: slot s is this bitmap and slot[s] is unused
+    bt_dir_miss *miss;      // why slot s last failed to become a bitmap
+    int bits;       // 2^bits slots
+    int shift;      // slot = (encoded key - base) >> shift
+    unsigned base;  // smallest sampled key, encoded
+} bt_dir;
+
+// Flip the sign bit so unsigned order is integer order
+static unsigned bt_dir_encode(int k) {
+    return (unsigned)k ^ 0x80000000u;
+}
+
+static long bt_dir_slot(const bt_dir *d, int k) {
+    unsigned u = bt_dir_encode(k);
+    if (u < d->base) return 0;
+    unsigned long s = (unsigned long)(u - d->base) >> d->shift;
+    unsigned long last = (1UL << d->bits) - 1;
+    return (long)(s > last ? last : s);
+}
+
+// Size the directory for expected_keys keys distributed like sample[0..nsample)
+void bt_dir_init(bt_dir *d, const int *sample, long nsample, long expected_keys) {
+    unsigned lo = 0, hi = UINT_MAX;
+    if (nsample > 0) {
+        lo = hi = bt_dir_encode(sample[0]);
+        for (long i = 1; i < nsample; ++i) {
+            unsigned u = bt_dir_encode(sample[i]);
+            if (u < lo) lo = u;
+            if (u > hi) hi = u;
+        }
+    }
+    unsigned long span = (unsigned long)(hi - lo) + 1;
+    int bits = 0;
+    while (bits < BT_DIR_MAX_BITS && (expected_keys >> bits) > BT_DIR_KEYS_PER_SLOT) bits++;
+    while (bits > 0 && (1UL << bits) > span) bits--; // no more slots than values
+    int shift = 0;
+    while (((span - 1) >> shift) >= (1UL << bits)) shift++;
+    d->bits = bits;
+    d->shift = shift;
+    d->base = lo;
+    d->slot = (BTreeNode **)calloc(1UL << bits, sizeof(BTreeNode *));
+    d->bitmap = (bt_dir_bitmap **)calloc(1UL << bits, sizeof(bt_dir_bitmap *));
+    d->miss = (bt_dir_miss *)calloc(1UL << bits, sizeof(bt_dir_miss));
+    if (!d->slot || !d->bitmap || !d->miss) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Encoded value of bit 0 of slot s
+static unsigned long bt_dir_first(const bt_dir *d, long s) {
+    return (unsigned long)d->base + ((unsigned long)s << d->shift);
+}
+
+// Is k inside slot s's own interval, i.e. representable in its bitmap?
+static bool bt_dir_owns(const bt_dir *d, long s, int k) {
+    unsigned long u = bt_dir_encode(k), first = bt_dir_first(d, s);
+    return u >= first && u - first < (1UL << d->shift);
+}
+
+static long bt_dir_words(const bt_dir *d) {
+    return d->shift >= 6 ? 1L << (d->shift - 6) : 1;
+}
+
+// Bit offsets [*a, *e] of slot s that fall inside [lo, hi]; false if none do
+static bool bt_dir_clip(const bt_dir *d, long s, int lo, int hi, unsigned long *a, unsigned long *e) {
+    unsigned long first = bt_dir_first(d, s), last = first + (1UL << d->shift) - 1;
+    unsigned long ulo = bt_dir_encode(lo), uhi = bt_dir_encode(hi);
+    if (ulo < first) ulo = first;
+    if (uhi > last) uhi = last;
+    if (ulo > uhi) return false;
+    *a = ulo - first;
+    *e = uhi - first;
+    return true;
+}
+
+// Set bits of b in [a, e] by popcount
+static long bt_dir_bits_count(const bt_dir_bitmap *b, unsigned long a, unsigned long e) {
+    unsigned long wa = a >> 6, we = e >> 6;
+    unsigned long long lo_mask = ~0ULL << (a & 63), hi_mask = ~0ULL >> (63 - (e & 63));
+    if (wa == we) return __builtin_popcountll(b->words[wa] & lo_mask & hi_mask);
+    long c = __builtin_popcountll(b->words[wa] & lo_mask) + __builtin_popcountll(b->words[we] & hi_mask);
+    for (unsigned long w = wa + 1; w < we; ++w) c += __builtin_popcountll(b->words[w]);
+    return c;
+}
+
+// Walk the set bits of slot s in [a, e] in order: sums them into *sum and
+// appends them to out unless it is NULL; returns how many there were
+static long bt_dir_bits_scan(const bt_dir *d, long s, unsigned long a, unsigned long e, long long *sum, int *out) {
+    const bt_dir_bitmap *b = d->bitmap[s];
+    unsigned long first = bt_dir_first(d, s);
+    long c = 0;
+    for (unsigned long w = a >> 6; w <= e >> 6; ++w) {
+        unsigned long long bits = b->words[w];
+        if (w == a >> 6) bits &= ~0ULL << (a & 63);
+        if (w == e >> 6) bits &= ~0ULL >> (63 - (e & 63));
+        while (bits) {
+            int k = (int)((unsigned)(first + (w << 6) + __builtin_ctzll(bits)) ^ 0x80000000u);
+            bits &= bits - 1;
+            *sum += k;
+            if (out) out[c] = k;
+            c++;
+        }
+    }
+    return c;
+}
+
+// Replace slot s's subtree by a bitmap, unless it holds duplicates or keys
+// from outside the slot's interval
+// Turn subtree slot s into a bitmap. Fails, leaving the subtree alone and the
+// offending key in *blocker, if it holds a duplicate or a key outside the slot.
+static bool bt_dir_to_bitmap(bt_dir *d, long s, int *blocker) {
+    BTreeNode *root = d->slot[s];
+    long n = bt_size(root);
+    int *keys = (int *)malloc(sizeof(int) * (n > 0 ? n : 1));
+    bt_dir_bitmap *b = (bt_dir_bitmap *)calloc(1, sizeof(bt_dir_bitmap) + sizeof(unsigned long long) * bt_dir_words(d));
+    if (!keys || !b) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    bt_range_collect(root, INT_MIN, INT_MAX, keys, NULL);
+    unsigned long first = bt_dir_first(d, s);
+    for (long i = 0; i < n; ++i) {
+        if (!bt_dir_owns(d, s, keys[i]) || (i > 0 && keys[i] == keys[i - 1])) {
+            *blocker = keys[i];
+            free(keys);
+            free(b);
+            return false;
+        }
+        unsigned long off = bt_dir_encode(keys[i]) - first;
+        b->words[off >> 6] |= 1ULL << (off & 63);
+        b->sum += keys[i];
+    }
+    b->ones = n;
+    free(keys);
+    bt_free(root);
+    d->slot[s] = NULL;
+    d->bitmap[s] = b;
+    return true;
+}
+
+// Turn bitmap slot s back into a subtree
+static void bt_dir_to_tree(bt_dir *d, long s) {
+    bt_dir_bitmap *b = d->bitmap[s];
+    int *keys = (int *)malloc(sizeof(int) * (b->ones > 0 ? b->ones : 1));
+    if (!keys) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    long long sum = 0;
+    long n = bt_dir_bits_scan(d, s, 0, (1UL << d->shift) - 1, &sum, keys);
+    d->slot[s] = bt_build(keys, n, NULL);
+    free(keys);
+    free(b);
+    d->bitmap[s] = NULL;
+}
+
+// Try to turn subtree slot s into a bitmap if it is dense enough; unblocked
+// says that the key behind the last failure was just removed
+static void bt_dir_check_dense(bt_dir *d, long s, bool unblocked) {
+    if (d->shift > BT_DIR_BITMAP_MAX_SHIFT) return;
+    bt_dir_miss *m = &d->miss[s];
+    long n = bt_size(d->slot[s]);
+    long dense = ((1L << d->shift) + BT_DIR_DENSE - 1) / BT_DIR_DENSE;
+    long moved = n > m->size ? n - m->size : m->size - n;
+    if (n < dense) return;
+    if (m->size > 0 && !unblocked && (moved == 0 || moved < m->size / BT_DIR_RETRY)) return;
+    m->size = bt_dir_to_bitmap(d, s, &m->key) ? 0 : n;
+}
+
+void bt_dir_insert(bt_dir *d, int k) {
+    long s = bt_dir_slot(d, k);
+    bt_dir_bitmap *b = d->bitmap[s];
+    if (b) {
+        if (bt_dir_owns(d, s, k)) {
+            unsigned long off = bt_dir_encode(k) - bt_dir_first(d, s);
+            unsigned long long bit = 1ULL << (off & 63);
+            if (!(b->words[off >> 6] & bit)) {
+                b->words[off >> 6] |= bit;
+                b->ones++;
+                b->sum += k;
+                return;
+            }
+        }
+        bt_dir_to_tree(d, s); // a duplicate or a stray key: the subtree keeps it
+    }
+    d->slot[s] = bt_insert(d->slot[s], k);
+    bt_dir_check_dense(d, s, false);
+}
+
+bool bt_dir_search(const bt_dir *d, int k) {
+    long s = bt_dir_slot(d, k);
+    const bt_dir_bitmap *b = d->bitmap[s];
+    if (!b) return bt_search(d->slot[s], k);
+    if (!bt_dir_owns(d, s, k)) return false;
+    unsigned long off = bt_dir_encode(k) - bt_dir_first(d, s);
+    return b->words[off >> 6] >> (off & 63) & 1;
+}
+
+void bt_dir_remove(bt_dir *d, int k) {
+    long s = bt_dir_slot(d, k);
+    bt_dir_bitmap *b = d->bitmap[s];
+    if (!b) {
+        d->slot[s] = bt_remove(d->slot[s], k);
+        bt_dir_check_dense(d, s, d->miss[s].size > 0 && k == d->miss[s].key);
+        return;
+    }
+    if (!bt_dir_owns(d, s, k)) return;
+    unsigned long off = bt_dir_encode(k) - bt_dir_first(d, s);
+    unsigned long long bit = 1ULL << (off & 63);
+    if (!(b->words[off >> 6] & bit)) return;
+    b->words[off >> 6] &= ~bit;
+    b->ones--;
+    b->sum -= k;
+    if (b->ones * BT_DIR_SPARSE < (1L << d->shift)) bt_dir_to_tree(d, s);
+}
+
+// Number and sum of the keys of slot s in [lo, hi]
+static long bt_dir_slot_count(const bt_dir *d, long s, int lo, int hi) {
+    unsigned long a, e;
+    if (!d->bitmap[s]) return bt_range_count(d->slot[s], lo, hi);
+    return bt_dir_clip(d, s, lo, hi, &a, &e) ? bt_dir_bits_count(d->bitmap[s], a, e) : 0;
+}
+
+static long long bt_dir_slot_sum(const bt_dir *d, long s, int lo, int hi) {
+    unsigned long a, e;
+    long long sum = 0;
+    if (!d->bitmap[s]) return bt_range_sum(d->slot[s], lo, hi);
+    if (bt_dir_clip(d, s, lo, hi, &a, &e)) bt_dir_bits_scan(d, s, a, e, &sum, NULL);
+    return sum;
+}
+
+// Number of keys in [lo, hi]
+long bt_dir_range_count(const bt_dir *d, int lo, int hi) {
+    if (lo > hi) return 0;
+    long a = bt_dir_slot(d, lo), b = bt_dir_slot(d, hi);
+    long cnt = bt_dir_slot_count(d, a, lo, hi);
+    if (a == b) return cnt;
+    for (long s = a + 1; s < b; ++s) cnt += d->bitmap[s] ? d->bitmap[s]->ones : bt_size(d->slot[s]);
+    return cnt + bt_dir_slot_count(d, b, lo, hi);
+}
+
+// Sum of keys in [lo, hi]
+long long bt_dir_range_sum(const bt_dir *d, int lo, int hi) {
+    if (lo > hi) return 0;
+    long a = bt_dir_slot(d, lo), b = bt_dir_slot(d, hi);
+    long long sum = bt_dir_slot_sum(d, a, lo, hi);
+    if (a == b) return sum;
+    for (long s = a + 1; s < b; ++s)
+        sum += d->bitmap[s] ? d->bitmap[s]->sum : bt_range_sum(d->slot[s], INT_MIN, INT_MAX);
+    return sum + bt_dir_slot_sum(d, b, lo, hi);
+}
+
+// Copy the keys in [lo, hi] to out in ascending order; returns how many
+long bt_dir_range_collect(const bt_dir *d, int lo, int hi, int *out) {
+    if (lo > hi) return 0;
+    long n = 0;
+    for (long s = bt_dir_slot(d, lo); s <= bt_dir_slot(d, hi); ++s) {
+        unsigned long a, e;
+        long long sum = 0;
+        if (!d->bitmap[s]) n += bt_range_collect(d->slot[s], lo, hi, out + n, NULL);
+        else if (bt_dir_clip(d, s, lo, hi, &a, &e)) n += bt_dir_bits_scan(d, s, a, e, &sum, out + n);
+    }
+    return n;
+}
+
+static size_t bt_dir_tree_bytes(const BTreeNode *node) {
+    if (!node) return 0;
+    size_t bytes = bt_node_bytes(node);
+    if (!node->leaf)
+        for (int i = 0; i <= node->n; ++i) bytes += bt_dir_tree_bytes(node->children[i]);
+    return bytes;
+}
+
+// Heap bytes held by the directory's subtrees and bitmaps; *bitmaps gets the
+// number of bitmap slots
+size_t bt_dir_bytes(const bt_dir *d, long *bitmaps) {
+    size_t bytes = (sizeof(BTreeNode *) + sizeof(bt_dir_bitmap *) + sizeof(bt_dir_miss)) << d->bits;
+    *bitmaps = 0;
+    for (long s = 0; s < (1L << d->bits); ++s) {
+        if (d->bitmap[s]) {
+            bytes += sizeof(bt_dir_bitmap) + sizeof(unsigned long long) * bt_dir_words(d);
+            (*bitmaps)++;
+        } else {
+            bytes += bt_dir_tree_bytes(d->slot[s]);
+        }
+    }
+    return bytes;
+}
+
+void bt_dir_free(bt_dir *d) {
+    for (long s = 0; s < (1L << d->bits); ++s) {
+        bt_free(d->slot[s]);
+        free(d->bitmap[s]);
+    }
+    free(d->slot);
+    free(d->bitmap);
+    free(d->miss);
+    d->slot = NULL;
+    d->bitmap = NULL;
+    d->miss = NULL;
+}
+
+// ---- Tree health statistics ----
+// One pass over the nodes (no keys are printed) that summarises the shape of the
+// tree: height, nodes per level, how full leaves and internal nodes are, and how
+// much of the allocated node memory holds live keys and child links. Output as
+// JSON so it can be scraped, e.g. to decide when a bulk rebuild would pay off.
+
+typedef struct bt_health {
+    int height;                      // levels, 0 for an empty tree
+    int min_height;                  // height of a perfectly packed tree with the same keys
+    long nodes, leaves, internal;
+    long keys;
+    long level_nodes[BT_MAX_LEVELS]; // nodes per level, root is level 0
+    long leaf_fill[2 * T];           // leaf_fill[k] = leaves holding k keys
+    long internal_fill[2 * T];       // same for internal nodes
+    size_t bytes_allocated;          // node memory (malloc overhead not included)
+    size_t bytes_used;               // bytes of it holding live keys and child entries
+} bt_health;
+
+static void bt_health_walk(BTreeNode *node, int level, bt_health *h) {
+    if (level + 1 > h->height) h->height = level + 1;
+    if (level < BT_MAX_LEVELS) h->level_nodes[level]++;
+    h->nodes++;
+    h->keys += node->n;
+    h->bytes_allocated += bt_node_bytes(node);
+    h->bytes_used += node->n * sizeof(node->keys[0]);
+#ifdef BT_MULTISET
+    h->bytes_used += node->n * sizeof(node->counts[0]);
+#endif
+    if (node->leaf) {
+        h->leaves++;
+        h->leaf_fill[node->n]++;
+        return;
+    }
+    h->internal++;
+    h->internal_fill[node->n]++;
+    h->bytes_used += (node->n + 1) * (sizeof(node->children[0]) + sizeof(node->cnt[0]) + sizeof(node->sum[0]));
+    for (int i = 0; i <= node->n; ++i)
+        bt_health_walk(node->children[i], level + 1, h);
+}
+
+void bt_health_collect(BTreeNode *root, bt_health *h) {
+    memset(h, 0, sizeof(*h));
+    if (!root) return;
+    bt_health_walk(root, 0, h);
+    // a packed tree holds (2T)^levels - 1 keys
+    long capacity = 0;
+    while (capacity < h->keys) {
+        capacity = capacity * (2 * T) + (2 * T - 1);
+        h->min_height++;
+    }
+}
+
+// Average keys per node relative to the 2T-1 maximum, in [0, 1]
+double bt_health_fill(const bt_health *h) {
+    return h->nodes ? (double)h->keys / ((double)h->nodes * (2 * T - 1)) : 0.0;
+}
+
+// A rebuild pays off when nodes are mostly empty or the tree is taller than needed
+bool bt_health_rebuild_advised(const bt_health *h) {
+    return h->nodes > 1 && (bt_health_fill(h) < 0.6 || h->height > h->min_height + 1);
+}
+
+void bt_health_json(const bt_health *h, FILE *out) {
+    fprintf(out, "{\"height\":%d,\"min_height\":%d,\"keys\":%ld,\"nodes\":%ld,"
+                 "\"leaves\":%ld,\"internal\":%ld,\"leaf_internal_ratio\":%.3f,",
+            h->height, h->min_height, h->keys, h->nodes, h->leaves, h->internal,
+            h->internal ? (double)h->leaves / h->internal : 0.0);
+    fprintf(out, "\"level_nodes\":[");
+    for (int l = 0; l < h->height && l < BT_MAX_LEVELS; ++l)
+        fprintf(out, "%s%ld", l ? "," : "", h->level_nodes[l]);
+    fprintf(out, "],\"leaf_fill\":[");
+    for (int k = 0; k < 2 * T; ++k)
+        fprintf(out, "%s%ld", k ? "," : "", h->leaf_fill[k]);
+    fprintf(out, "],\"internal_fill\":[");
+    for (int k = 0; k < 2 * T; ++k)
+        fprintf(out, "%s%ld", k ? "," : "", h->internal_fill[k]);
+    fprintf(out, "],\"avg_fill\":%.3f,\"bytes_allocated\":%zu,\"bytes_used\":%zu,"
+                 "\"rebuild_advised\":%s}\n",
+            bt_health_fill(h), h->bytes_allocated, h->bytes_used,
+            bt_health_rebuild_advised(h) ? "true" : "false");
+}
+
+// ---- Finger search ----
+// A finger remembers the root-to-leaf path of the previous operation together with
+// the open key range (lo, hi) each node on it covers. The next lookup or insert
+// climbs only as far as the first ancestor whose range holds the new key and
+// descends from there, so a stream of nearby keys skips most of the descent.
+// The path is dropped whenever bt_epoch moves on (splits, merges, borrows,
+// compaction) outside the part of the path the finger itself just rebuilt.
+
+typedef struct bt_finger {
+    BTreeNode *root;                  // tree the path belongs to
+    unsigned long epoch;              // bt_epoch when the path was recorded
+    int depth;                        // number of valid levels, 0 = none
+    BTreeNode *node[BT_MAX_LEVELS];
+    int idx[BT_MAX_LEVELS];           // child taken below node[l]
+    long long lo[BT_MAX_LEVELS];      // node[l] holds keys in (lo[l], hi[l])
+    long long hi[BT_MAX_LEVELS];
+} bt_finger;
+
+void bt_finger_init(bt_finger *f) {
+    f->root = NULL;
+    f->depth = 0;
+}
+
+// Point the finger at the node holding k, or at the leaf where k would go.
+// Returns true if k was found; the path then ends at the node holding it.
+static bool bt_finger_seek(bt_finger *f, BTreeNode *root, int k) {
+    if (f->root != root || f->epoch != bt_epoch || f->depth == 0) {
+        f->root = root;
+        f->epoch = bt_epoch;
+        f->depth = 1;
+        f->node[0] = root;
+        f->lo[0] = LLONG_MIN;
+        f->hi[0] = LLONG_MAX;
+    }
+    int l = f->depth - 1;
+    while (l > 0 && !(f->lo[l] < k && k < f->hi[l])) l--;
+    for (;;) {
+        BTreeNode *x = f->node[l];
+        int i = 0;
+        while (i < x->n && k > x->keys[i]) i++;
+        BT_STAT_VISIT(i + 1);
+        f->idx[l] = i;
+        if ((i < x->n && x->keys[i] == k) || x->leaf || l + 1 == BT_MAX_LEVELS) {
+            f->depth = l + 1;
+            return i < x->n && x->keys[i] == k;
+        }
+        f->node[l + 1] = x->children[i];
+        f->lo[l + 1] = i > 0 ? x->keys[i - 1] : f->lo[l];
+        f->hi[l + 1] = i < x->n ? x->keys[i] : f->hi[l];
+        l++;
+    }
+}
+
+bool bt_finger_search(bt_finger *f, BTreeNode *root, int k) {
+    if (!root) return false;
+    BT_OP_BEGIN(BT_OP_SEARCH);
+    bool found = bt_finger_seek(f, root, k);
+    BT_OP_END(BT_OP_SEARCH);
+    return found;
+}
+
+// Insert k starting from the lowest non-full node on the finger's path
+BTreeNode *bt_finger_insert(bt_finger *f, BTreeNode *root, int k) {
+    if (!root || root->n == 2 * T - 1) {
+        f->depth = 0;
+        return bt_insert(root, k);
+    }
+    BT_OP_BEGIN(BT_OP_INSERT);
+    if (bt_finger_seek(f, root, k) && BT_COUNTED) {
+        // counted build: the path ends at k's entry, which just gains a copy
+        int l = f->depth - 1;
+        bt_count_path(f->node, f->idx, l, f->node[l], f->idx[l], 1);
+        BT_OP_END(BT_OP_INSERT);
+        return root;
+    }
+    int l = f->depth - 1;
+    while (l > 0 && f->node[l]->n == 2 * T - 1) l--;
+    unsigned long before = bt_epoch;
+    bt_insert_nonfull(f->node[l], k);
+    // the nodes above the start gained exactly one key below them
+    for (int j = l - 1; j >= 0; --j) {
+        f->node[j]->cnt[f->idx[j]] += 1;
+        f->node[j]->sum[f->idx[j]] += k;
+    }
+    // splits only happened below node[l]; the path down to it is still exact
+    if (bt_epoch != before) {
+        f->depth = l + 1;
+        f->epoch = bt_epoch;
+    }
+    BT_OP_END(BT_OP_INSERT);
+    return root;
+}
+
+// Print tree structure (preorder) with indentation
+void bt_print(BTreeNode *root, int level) {
+    if (!root) return;
+    for (int i = 0; i < level; ++i) printf("  ");
+    printf("[");
+    for (int i = 0; i < root->n; ++i) {
+        printf("%d", root->keys[i]);
+        if (i + 1 < root->n) printf(" ");
+    }
+    printf("]\n");
+    if (!root->leaf) {
+        for (int i = 0; i <= root->n; ++i)
+            bt_print(root->children[i], level + 1);
+    }
+}
+
+// ---- Compaction ----
+// After many inserts and removals the nodes are scattered over the heap. bt_compact
+// copies the whole tree into one cache-line aligned block, either level by level
+// (breadth-first) or in van Emde Boas order, where every subtree of about sqrt(n)
+// nodes is itself contiguous so a root-to-leaf walk touches few cache lines and
+// pages at every scale. Stop-the-world: the old root must not be used afterwards.
+
+enum { BT_LAYOUT_BFS, BT_LAYOUT_VEB };
+
+static void bt_count_nodes(BTreeNode *node, long *nodes, int depth, int *height) {
+    (*nodes)++;
+    if (depth + 1 > *height) *height = depth + 1;
+    if (!node->leaf) {
+        for (int i = 0; i <= node->n; ++i)
+            bt_count_nodes(node->children[i], nodes, depth + 1, height);
+    }
+}
+
+static void bt_veb_layout(BTreeNode *node, int h, BTreeNode **order, long *pos);
+
+// Lay out, left to right, every subtree hanging depth levels below node
+static void bt_veb_bottoms(BTreeNode *node, int depth, int h, BTreeNode **order, long *pos) {
+    if (depth == 0) {
+        bt_veb_layout(node, h, order, pos);
+        return;
+    }
+    for (int i = 0; i <= node->n; ++i)
+        bt_veb_bottoms(node->children[i], depth - 1, h, order, pos);
+}
+
+// Emit the top h levels under node: the upper half first, then each lower subtree
+static void bt_veb_layout(BTreeNode *node, int h, BTreeNode **order, long *pos) {
+    if (h == 1) {
+        order[(*pos)++] = node;
+        return;
+    }
+    int top = h / 2;
+    bt_veb_layout(node, top, order, pos);
+    bt_veb_bottoms(node, top, h - top, order, pos);
+}
+
+BTreeNode *bt_compact(BTreeNode *root, int layout) {
+    if (!root) return NULL;
+    long nodes = 0, pos = 0;
+    int height = 0;
+    bt_count_nodes(root, &nodes, 0, &height);
+
+    BTreeNode **order = (BTreeNode **)malloc(sizeof(BTreeNode *) * nodes);
+    bt_arena *a = (bt_arena *)malloc(sizeof(bt_arena));
+    long cap = nodes + nodes / 16 + 1; // a little slack for nodes created later
+    void *base = NULL;
+    if (!order || !a || posix_memalign(&base, 64, sizeof(BTreeNode) * cap) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (layout == BT_LAYOUT_VEB) {
+        bt_veb_layout(root, height, order, &pos);
+    } else {
+        order[pos++] = root; // the order array doubles as the BFS queue
+        for (long head = 0; head < pos; ++head) {
+            if (!order[head]->leaf) {
+                for (int i = 0; i <= order[head]->n; ++i)
+                    order[pos++] = order[head]->children[i];
+            }
+        }
+    }
+
+    // Copy every node, then leave a forwarding pointer to the copy over the old
+    // node's keys (leaves have no children[0]) and use it to redirect the
+    // copies' child links
+    a->base = (BTreeNode *)base;
+    a->cap = cap;
+    a->live = nodes;
+    a->free_list = NULL;
+    for (long i = 0; i < nodes; ++i) memcpy(&a->base[i], order[i], bt_node_bytes(order[i]));
+    for (long i = 0; i < nodes; ++i) {
+        BTreeNode *copy = &a->base[i];
+        memcpy(order[i]->keys, &copy, sizeof(copy));
+    }
+    for (long i = 0; i < nodes; ++i) {
+        BTreeNode *copy = &a->base[i];
+        if (!copy->leaf) {
+            for (int j = 0; j <= copy->n; ++j)
+                memcpy(&copy->children[j], copy->children[j]->keys, sizeof(copy->children[j]));
+        }
+    }
+    for (long i = nodes; i < cap; ++i) {
+        a->base[i].children[0] = a->free_list;
+        a->free_list = &a->base[i];
+    }
+    for (long i = 0; i < nodes; ++i) bt_release_node(order[i]);
+    a->next = bt_arenas;
+    bt_arenas = a;
+    bt_epoch++;
+
+    free(order);
+    return &a->base[0];
+}
+
+// ---- Frozen read-only layout ----
+// bt_freeze copies the keys of a finished tree into a pointer-free array in
+// Eytzinger (BFS) order: the children of slot k sit at 2k and 2k+1. A lookup is a
+// fixed-shape loop with no unpredictable branches, and the 16 descendants four
+// levels down share one cache line, so they are prefetched while the current
+// level is compared. The array is n + 1 ints rounded up to whole cache lines;
+// prefetches past its end are harmless. The frozen copy is independent of the
+// tree it came from.
+
+typedef struct bt_frozen {
+    int *keys;  // keys[1..n] in Eytzinger order; keys[0] is unused
+    long n;
+} bt_frozen;
+
+static void bt_collect_keys(BTreeNode *node, int *out, long *pos) {
+    for (int i = 0; i < node->n; ++i) {
+        if (!node->leaf) bt_collect_keys(node->children[i], out, pos);
+        out[(*pos)++] = node->keys[i];
+    }
+    if (!node->leaf) bt_collect_keys(node->children[node->n], out, pos);
+}
+
+// Place sorted[*pos..] into the implicit tree rooted at slot k, in order
+static void bt_eytzinger_fill(const int *sorted, long *pos, int *keys, long k, long n) {
+    if (k > n) return;
+    bt_eytzinger_fill(sorted, pos, keys, 2 * k, n);
+    keys[k] = sorted[(*pos)++];
+    bt_eytzinger_fill(sorted, pos, keys, 2 * k + 1, n);
+}
+
+// keys[0..n] rounded up to a multiple of the 64-byte alignment
+static size_t bt_frozen_array_bytes(long n) {
+    return (sizeof(int) * (n + 1) + 63) & ~(size_t)63;
+}
+
+bt_frozen *bt_freeze(BTreeNode *root) {
+    bt_frozen *f = (bt_frozen *)malloc(sizeof(bt_frozen));
+    long n = 0, pos = 0;
+    // a counted tree stores each key once, so collect first and count what came out
+    int *sorted = (int *)malloc(sizeof(int) * (bt_size(root) + 1));
+    if (sorted && root) bt_collect_keys(root, sorted, &n);
+    void *mem = NULL;
+    if (!f || !sorted || posix_memalign(&mem, 64, bt_frozen_array_bytes(n)) != 0) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    f->keys = (int *)mem;
+    f->n = n;
+    pos = 0;
+    bt_eytzinger_fill(sorted, &pos, f->keys, 1, n);
+    free(sorted);
+    return f;
+}
+
+// Slot of the first key >= k, or 0 if every key is smaller
+static long bt_frozen_slot(const bt_frozen *f, int k) {
+    long i = 1;
+    while (i <= f->n) {
+        // an address, not a pointer: slot 16i is usually past the array
+        __builtin_prefetch((const void *)((uintptr_t)f->keys + sizeof(int) * 16 * (uintptr_t)i));
+        i = 2 * i + (f->keys[i] < k);
+    }
+    // undo the trailing right turns (1 bits) and the last left turn
+    return i >> __builtin_ffsl(~i);
+}
+
+bool bt_frozen_lower_bound(const bt_frozen *f, int k, int *out) {
+    long i = bt_frozen_slot(f, k);
+    if (i == 0) return false;
+    *out = f->keys[i];
+    return true;
+}
+
+bool bt_frozen_search(const bt_frozen *f, int k) {
+    long i = bt_frozen_slot(f, k);
+    return i != 0 && f->keys[i] == k;
+}
+
+// Heap bytes held by the frozen copy
+size_t bt_frozen_bytes(const bt_frozen *f) {
+    return sizeof(bt_frozen) + bt_frozen_array_bytes(f->n);
+}
+
+void bt_frozen_free(bt_frozen *f) {
+    if (!f) return;
+    free(f->keys);
+    free(f);
+}
+
+// ---- Parallel bulk build ----
+// bt_build makes a tree out of an unsorted key array without calling bt_insert
+// once per key. First it sorts the keys with a merge sort whose halves and merges
+// run on the pool. Then it lays the tree out top-down. A subtree of height h
+// holding m keys picks a fan-out, gives each child an equal share of the keys,
+// and puts one separator between neighbouring children. The children cover
+// disjoint slices of the sorted array, so they are built as independent pool
+// tasks. Joining them only takes the parent's child pointers and aggregates.
+// Nodes are filled to 2T-2 keys where the bounds allow it, so the first insert
+// into a freshly built leaf does not split it. pool may be NULL to build on the
+// calling thread only.
+
+#define BT_BUILD_GRAIN 16384 // sort, merge or build pieces smaller than this without forking
+
+static int bt_int_cmp(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Arguments of one forked merge or sort, so it can run as a pool task
+typedef struct bt_sort_args {
+    int *a, *b, *out;
+    long na, nb;
+    bool into_b;
+    wp_pool *pool;
+} bt_sort_args;
+
+// Merge sorted a[0..na) and b[0..nb) into out. Big merges split at the median
+// of the longer run and merge the two halves in parallel.
+static void bt_merge_task(void *p) {
+    bt_sort_args *s = (bt_sort_args *)p;
+    if (s->na < s->nb) {
+        int *a = s->a; s->a = s->b; s->b = a;
+        long na = s->na; s->na = s->nb; s->nb = na;
+    }
+    if (!s->pool || s->na + s->nb < BT_BUILD_GRAIN) {
+        long i = 0, j = 0, o = 0;
+        while (i < s->na && j < s->nb) s->out[o++] = s->b[j] < s->a[i] ? s->b[j++] : s->a[i++];
+        while (i < s->na) s->out[o++] = s->a[i++];
+        while (j < s->nb) s->out[o++] = s->b[j++];
+        return;
+    }
+    long ma = s->na / 2, lo = 0, hi = s->nb;
+    while (lo < hi) { // first b element not below a[ma]
+        long mid = lo + (hi - lo) / 2;
+        if (s->b[mid] < s->a[ma]) lo = mid + 1;
+        else hi = mid;
+    }
+    s->out[ma + lo] = s->a[ma];
+    bt_sort_args left = {s->a, s->b, s->out, ma, lo, false, s->pool};
+    bt_sort_args right = {s->a + ma + 1, s->b + lo, s->out + ma + lo + 1,
+                          s->na - ma - 1, s->nb - lo, false, s->pool};
+    wp_task task;
+    wp_spawn(s->pool, &task, bt_merge_task, &left);
+    bt_merge_task(&right);
+    wp_sync(s->pool, &task);
+}
+
+// Sort a[0..na) using b[0..na) as scratch; the result ends up in b if into_b,
+// otherwise in a. The halves land in the buffer the final merge reads from.
+static void bt_sort_task(void *p) {
+    bt_sort_args *s = (bt_sort_args *)p;
+    if (!s->pool || s->na < BT_BUILD_GRAIN) {
+        qsort(s->a, s->na, sizeof(int), bt_int_cmp);
+        if (s->into_b) memcpy(s->b, s->a, sizeof(int) * s->na);
+        return;
+    }
+    long h = s->na / 2;
+    bt_sort_args left = {s->a, s->b, NULL, h, 0, !s->into_b, s->pool};
+    bt_sort_args right = {s->a + h, s->b + h, NULL, s->na - h, 0, !s->into_b, s->pool};
+    wp_task task;
+    wp_spawn(s->pool, &task, bt_sort_task, &left);
+    bt_sort_task(&right);
+    wp_sync(s->pool, &task);
+    int *src = s->into_b ? s->a : s->b;
+    bt_sort_args merge = {src, src + h, s->into_b ? s->b : s->a, h, s->na - h, false, s->pool};
+    bt_merge_task(&merge);
+}
+
+// base^e, saturating at LONG_MAX
+static long bt_build_pow(long base, int e) {
+    long r = 1;
+    while (e-- > 0) {
+        if (r > LONG_MAX / base) return LONG_MAX;
+        r *= base;
+    }
+    return r;
+}
+
+// One subtree to build: keys[0..m) at the given height, with min_children as
+// the lower bound on its fan-out (2 for the root, T below it)
+typedef struct bt_build_args {
+    const int *keys;
+    long m;
+    int height, min_children;
+    BTreeNode *result;
+    wp_pool *pool;
+    const unsigned *counts; // copies of each key in counted builds, else NULL
+} bt_build_args;
+
+// Nodes come straight from malloc: the arena free lists are not thread-safe
+static BTreeNode *bt_build_node(bool leaf) {
+    BTreeNode *node = (BTreeNode *)malloc(leaf ? BT_LEAF_BYTES : sizeof(BTreeNode));
+    if (!node) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    node->leaf = leaf;
+    node->n = 0;
+    return node;
+}
+
+// A subtree with m keys has weight m+1, and a node's weight is the sum of its
+// children's weights. A child of height h weighs between T^(h+1) and (2T)^(h+1);
+// the fan-out is chosen so that every child gets a share of the weight inside
+// those bounds, as close to (2T-1)^(h+1) (nodes at 2T-2 keys) as possible.
+static void bt_build_task(void *p) {
+    bt_build_args *s = (bt_build_args *)p;
+    BTreeNode *x = bt_build_node(s->height == 0);
+    s->result = x;
+    if (x->leaf) {
+        memcpy(x->keys, s->keys, sizeof(int) * s->m);
+#ifdef BT_MULTISET
+        memcpy(x->counts, s->counts, sizeof(unsigned) * s->m);
+#endif
+        x->n = (int)s->m;
+        return;
+    }
+    long w = s->m + 1;
+    long max_w = bt_build_pow(2 * T, s->height);
+    long min_w = bt_build_pow(T, s->height);
+    long fill_w = bt_build_pow(2 * T - 1, s->height);
+    long c = (w + fill_w - 1) / fill_w;
+    long c_lo = (w + max_w - 1) / max_w, c_hi = w / min_w;
+    if (c_lo < s->min_children) c_lo = s->min_children;
+    if (c_hi > 2 * T) c_hi = 2 * T;
+    if (c < c_lo) c = c_lo;
+    if (c > c_hi) c = c_hi;
+
+    bt_build_args child[2 * T];
+    wp_task tasks[2 * T];
+    bool forked[2 * T];
+    long at = 0;
+    for (int i = 0; i < c; ++i) {
+        long cw = w / c + (i < w % c ? 1 : 0);
+        child[i] = (bt_build_args){s->keys + at, cw - 1, s->height - 1, T, NULL, s->pool,
+                                   s->counts ? s->counts + at : NULL};
+        at += cw - 1;
+        if (i + 1 < c) {
+            x->keys[i] = s->keys[at];
+#ifdef BT_MULTISET
+            x->counts[i] = s->counts[at];
+#endif
+            at++;
+        }
+        forked[i] = s->pool && i + 1 < c && cw >= BT_BUILD_GRAIN;
+        if (forked[i]) wp_spawn(s->pool, &tasks[i], bt_build_task, &child[i]);
+    }
+    x->n = (int)c - 1;
+    for (int i = (int)c - 1; i >= 0; --i) {
+        if (forked[i]) wp_sync(s->pool, &tasks[i]);
+        else bt_build_task(&child[i]);
+        x->children[i] = child[i].result;
+        bt_refresh_child(x, i);
+    }
+}
+
+// Build a tree from keys[0..n). keys is sorted in place; duplicates are kept
+// (a counted build also folds them together at the front of keys).
+BTreeNode *bt_build(int *keys, long n, wp_pool *pool) {
+    if (n <= 0) return NULL;
+    int *scratch = (int *)malloc(sizeof(int) * n);
+    if (!scratch) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    bt_sort_args sort = {keys, scratch, NULL, n, 0, false, pool};
+    bt_sort_task(&sort);
+    free(scratch);
+
+    unsigned *counts = NULL;
+#ifdef BT_MULTISET
+    // one entry per distinct key, carrying its number of copies
+    counts = (unsigned *)malloc(sizeof(unsigned) * n);
+    if (!counts) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    long distinct = 0;
+    for (long i = 0; i < n; ++i) {
+        if (distinct > 0 && keys[distinct - 1] == keys[i]) {
+            counts[distinct - 1]++;
+        } else {
+            keys[distinct] = keys[i];
+            counts[distinct++] = 1;
+        }
+    }
+    n = distinct;
+#endif
+
+    int height = 0;
+    while (bt_build_pow(2 * T, height + 1) < n + 1) height++;
+    bt_build_args root = {keys, n, height, 2, NULL, pool, counts};
+    bt_build_task(&root);
+    free(counts);
+    return root.result;
+}
+
+// ---- Leaf scan kernels ----
+// Leaves hold most of the keys, so a range scan spends most of its time on
+// their keys[] arrays. bt_kernel_range handles a whole array at once: it counts
+// the keys inside [lo, hi], sums them, tracks their min and max, and appends
+// them to an output buffer. With SSE2 the bounds test, the 64-bit sum and
+// min/max work on four keys per instruction without branching on keys. A block
+// that matches entirely is stored with one vector write. A leaf that lies
+// wholly inside the range skips the bounds test: its min and max are its first
+// and last keys, and its keys are copied out with memcpy. The bounds are the
+// only predicate the kernel evaluates itself; a bt_key_pred callback cannot be
+// vectorized and keeps the per-key path.
+
+typedef struct bt_scan_result {
+    long count;     // keys in range that satisfied the predicate
+    long long sum;
+    int min, max;   // only meaningful when count > 0
+} bt_scan_result;
+
+// Add the keys of keys[0..n) that lie in [lo, hi] to r, and append them to out
+// unless it is NULL; returns how many there were
+static int bt_kernel_range(const int *keys, int n, int lo, int hi, int *out, bt_scan_result *r) {
+    if (n == 0) return 0;
+    bool whole = keys[0] >= lo && keys[n - 1] <= hi;
+    int c = 0, i = 0;
+    long long sum = 0;
+    int mn = INT_MAX, mx = INT_MIN;
+#ifdef __SSE2__
+    __m128i vlo = _mm_set1_epi32(lo), vhi = _mm_set1_epi32(hi);
+    __m128i vsum = _mm_setzero_si128();
+    __m128i vmin = _mm_set1_epi32(INT_MAX), vmax = _mm_set1_epi32(INT_MIN);
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(keys + i));
+        __m128i in = whole ? _mm_set1_epi32(-1)
+                           : _mm_xor_si128(_mm_or_si128(_mm_cmplt_epi32(v, vlo), _mm_cmpgt_epi32(v, vhi)),
+                                           _mm_set1_epi32(-1));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(in));
+        if (!mask) continue;
+        // lanes outside the range add 0 to the sum and INT_MAX/INT_MIN to min/max
+        __m128i m = _mm_and_si128(v, in);
+        __m128i sign = _mm_srai_epi32(m, 31);
+        vsum = _mm_add_epi64(vsum, _mm_unpacklo_epi32(m, sign));
+        vsum = _mm_add_epi64(vsum, _mm_unpackhi_epi32(m, sign));
+        if (!whole) {
+            __m128i lt = _mm_cmplt_epi32(v, vmin), gt = _mm_cmpgt_epi32(v, vmax);
+            lt = _mm_and_si128(lt, in);
+            gt = _mm_and_si128(gt, in);
+            vmin = _mm_or_si128(_mm_and_si128(lt, v), _mm_andnot_si128(lt, vmin));
+            vmax = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, vmax));
+        }
+        if (out) {
+            if (mask == 15) {
+                _mm_storeu_si128((__m128i *)(out + c), v);
+            } else {
+                int o = c;
+                for (int j = 0; j < 4; ++j)
+                    if (mask >> j & 1) out[o++] = keys[i + j];
+            }
+        }
+        c += __builtin_popcount((unsigned)mask);
+    }
+    long long lanes[2];
+    int mins[4], maxs[4];
+    _mm_storeu_si128((__m128i *)lanes, vsum);
+    _mm_storeu_si128((__m128i *)mins, vmin);
+    _mm_storeu_si128((__m128i *)maxs, vmax);
+    sum = lanes[0] + lanes[1];
+    for (int j = 0; j < 4; ++j) {
+        if (mins[j] < mn) mn = mins[j];
+        if (maxs[j] > mx) mx = maxs[j];
+    }
+#endif
+    for (; i < n; ++i) {
+        int k = keys[i];
+        if (!whole && (k < lo || k > hi)) continue;
+        sum += k;
+        if (k < mn) mn = k;
+        if (k > mx) mx = k;
+        if (out) out[c] = k;
+        c++;
+    }
+    if (c == 0) return 0;
+    if (whole) {
+        mn = keys[0];
+        mx = keys[n - 1];
+    }
+    if (r->count == 0 || mn < r->min) r->min = mn;
+    if (r->count == 0 || mx > r->max) r->max = mx;
+    r->count += c;
+    r->sum += sum;
+    return c;
+}
+
+// ---- Parallel range scan ----
+// Plain count and sum queries are answered by bt_range_count and bt_range_sum
+// from the aggregates in O(height). bt_scan_range is for work that has to look
+// at every key in a range: filtering with a predicate, min/max of the matching
+// keys, or copying them out. It runs that linear scan on the pool. The range is
+// first cut at the upper levels into pieces. A piece is either a whole subtree
+// of at most 1/8 of the range per thread, or one separator key between two
+// subtrees. The pieces run as pool tasks, so idle workers steal the ones not yet
+// started. Partial results are combined in key order: counts and sums add up,
+// and each piece's collected keys go to out at the offset given by the counts
+// of the pieces before it. Without a predicate the offsets are known from the
+// aggregates before the scan, so pieces write straight into out. With one, each
+// piece fills its own buffer, and a second parallel pass copies the buffers into
+// place. Without a predicate, leaves go through bt_kernel_range instead of
+// being scanned key by key.
+
+#define BT_SCAN_GRAIN 4096 // subtrees with fewer keys are never cut further
+
+typedef bool (*bt_key_pred)(int k, void *arg);
+
+typedef struct bt_scan_piece {
+    BTreeNode *node;  // subtree to scan, or NULL for the single separator key
+    int key;
+    long weight;      // copies of that key (more than one only in counted builds)
+    bt_scan_result res;
+    long offset;      // where the piece's first key goes in out
+    int *buf;         // the piece's own output when there is a predicate
+    long cap;
+} bt_scan_piece;
+
+typedef struct bt_scan {
+    int lo, hi;
+    bt_key_pred pred;
+    void *arg;
+    int *out;
+    bt_scan_piece *pieces;
+    long npieces, cap;
+    long target;      // subtrees with more keys than this are cut further
+    wp_pool *pool;
+} bt_scan;
+
+static bt_scan_piece *bt_scan_add(bt_scan *s, BTreeNode *node, int key, long weight) {
+    if (s->npieces == s->cap) {
+        s->cap = s->cap ? 2 * s->cap : 64;
+        s->pieces = (bt_scan_piece *)realloc(s->pieces, sizeof(bt_scan_piece) * s->cap);
+        if (!s->pieces) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    bt_scan_piece *p = &s->pieces[s->npieces++];
+    memset(p, 0, sizeof(*p));
+    p->node = node;
+    p->key = key;
+    p->weight = weight;
+    return p;
+}
+
+// Cut the part of x's subtree (size keys) that overlaps [lo, hi] into pieces, in key order
+static void bt_scan_cut(bt_scan *s, BTreeNode *x, long size) {
+    if (x->leaf || size <= s->target) {
+        bt_scan_add(s, x, 0, 0);
+        return;
+    }
+    for (int i = 0; i <= x->n; ++i) {
+        // children[i] holds keys between keys[i-1] and keys[i]
+        if (i > 0 && x->keys[i - 1] > s->hi) break;
+        if (i < x->n && x->keys[i] < s->lo) continue;
+        bt_scan_cut(s, x->children[i], x->cnt[i]);
+        if (i < x->n && x->keys[i] >= s->lo && x->keys[i] <= s->hi) bt_scan_add(s, NULL, x->keys[i], BT_KEY_WEIGHT(x, i));
+    }
+}
+
+// Account for w copies of k.
+static void bt_scan_key(const bt_scan *s, bt_scan_piece *p, int k, long w) {
+    if (k < s->lo || k > s->hi || (s->pred && !s->pred(k, s->arg))) return;
+    if (p->res.count == 0 || k < p->res.min) p->res.min = k;
+    if (p->res.count == 0 || k > p->res.max) p->res.max = k;
+    p->res.sum += (long long)k * w;
+    if (!s->out) {
+        p->res.count += w;
+        return;
+    }
+    for (long c = 0; c < w; ++c) {
+        if (!s->pred) {
+            s->out[p->offset + p->res.count] = k;
+        } else {
+            if (p->res.count == p->cap) {
+                p->cap = p->cap ? 2 * p->cap : 256;
+                p->buf = (int *)realloc(p->buf, sizeof(int) * p->cap);
+                if (!p->buf) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            p->buf[p->res.count] = k;
+        }
+        p->res.count++;
+    }
+}
+
+static void bt_scan_node(const bt_scan *s, bt_scan_piece *p, BTreeNode *x) {
+    if (!BT_COUNTED && x->leaf && !s->pred) {
+        bt_kernel_range(x->keys, x->n, s->lo, s->hi, s->out ? s->out + p->offset + p->res.count : NULL, &p->res);
+        return;
+    }
+    for (int i = 0; i < x->n || (!x->leaf && i == x->n); ++i) {
+        if (i > 0 && x->keys[i - 1] > s->hi) return;
+        if (!x->leaf && (i == x->n || x->keys[i] >= s->lo)) bt_scan_node(s, p, x->children[i]);
+        if (i < x->n) bt_scan_key(s, p, x->keys[i], BT_KEY_WEIGHT(x, i));
+    }
+}
+
+// Pieces [a, b) of a scan, forked in halves so the pool can balance them
+typedef struct bt_scan_args {
+    bt_scan *s;
+    long a, b;
+    bool copy;  // second pass: move the piece buffers into out
+} bt_scan_args;
+
+static void bt_scan_task(void *p) {
+    bt_scan_args *t = (bt_scan_args *)p;
+    bt_scan *s = t->s;
+    if (t->b - t->a == 1) {
+        bt_scan_piece *piece = &s->pieces[t->a];
+        if (t->copy) {
+            if (piece->buf) memcpy(s->out + piece->offset, piece->buf, sizeof(int) * piece->res.count);
+            free(piece->buf);
+        } else if (piece->node) {
+            bt_scan_node(s, piece, piece->node);
+        } else {
+            bt_scan_key(s, piece, piece->key, piece->weight);
+        }
+        return;
+    }
+    long mid = t->a + (t->b - t->a) / 2;
+    bt_scan_args left = {s, t->a, mid, t->copy}, right = {s, mid, t->b, t->copy};
+    wp_task task;
+    wp_spawn(s->pool, &task, bt_scan_task, &left);
+    bt_scan_task(&right);
+    wp_sync(s->pool, &task);
+}
+
+// Scan the keys in [lo, hi] that satisfy pred (NULL: all of them) on the pool.
+// res gets their count, sum, min and max. When out is not NULL the keys are
+// also copied there in ascending order, so out needs room for
+// bt_range_count(root, lo, hi) keys. pool may be NULL to scan on the calling
+// thread only.
+void bt_scan_range(BTreeNode *root, int lo, int hi, bt_key_pred pred, void *arg, int *out,
+                   bt_scan_result *res, wp_pool *pool) {
+    memset(res, 0, sizeof(*res));
+    long total = bt_range_count(root, lo, hi);
+    if (total == 0) return;
+    bt_scan s = {lo, hi, pred, arg, out, NULL, 0, 0, LONG_MAX, pool};
+    if (pool) {
+        s.target = total / (8L * (pool->nthreads + 1));
+        if (s.target < BT_SCAN_GRAIN) s.target = BT_SCAN_GRAIN;
+    }
+    bt_scan_cut(&s, root, bt_size(root));
+
+    long offset = 0;
+    if (out && !pred) {
+        for (long i = 0; i < s.npieces; ++i) {
+            bt_scan_piece *p = &s.pieces[i];
+            p->offset = offset;
+            offset += p->node ? bt_range_count(p->node, lo, hi) : p->weight;
+        }
+    }
+    bt_scan_args all = {&s, 0, s.npieces, false};
+    bt_scan_task(&all);
+
+    for (long i = 0; i < s.npieces; ++i) {
+        bt_scan_result *r = &s.pieces[i].res;
+        s.pieces[i].offset = res->count;
+        if (r->count == 0) continue;
+        if (res->count == 0 || r->min < res->min) res->min = r->min;
+        if (res->count == 0 || r->max > res->max) res->max = r->max;
+        res->count += r->count;
+        res->sum += r->sum;
+    }
+    if (out && pred) {
+        all.copy = true;
+        bt_scan_task(&all);
+    }
+    free(s.pieces);
+}
+
+// Copy the keys in [lo, hi] to out in ascending order; returns how many
+long bt_range_collect(BTreeNode *root, int lo, int hi, int *out, wp_pool *pool) {
+    bt_scan_result res;
+    bt_scan_range(root, lo, hi, NULL, NULL, out, &res, pool);
+    return res.count;
+}
+
+// Free every node of the tree
+void bt_free(BTreeNode *root) {
+    if (!root) return;
+    if (!root->leaf) {
+        for (int i = 0; i <= root->n; ++i)
+            bt_free(root->children[i]);
+    }
+    bt_release_node(root);
+}
+
+// Utility: generate N unique random numbers in range [0..maxv)
+void gen_unique_randoms(int *arr, int N, int maxv) {
+    if (N > maxv) {
+        fprintf(stderr, "Not enough unique values available\n");
+        exit(EXIT_FAILURE);
+    }
+    // simple reservoir-like / shuffle approach
+    int *pool = malloc(sizeof(int) * maxv);
+    for (int i = 0; i < maxv; ++i) pool[i] = i + 1; // 1..maxv
+    // Fisher-Yates shuffle first N positions
+    for (int i = 0; i < N; ++i) {
+        int j = i + rand() % (maxv - i);
+        int tmp = pool[i]; pool[i] = pool[j]; pool[j] = tmp;
+        arr[i] = pool[i];
+    }
+    free(pool);
+}
+
+#ifndef BT_NO_MAIN // Defined by drivers that include this file, e.g. bench.c
+static bool is_even(int k, void *arg) {
+    (void)arg;
+    return k % 2 == 0;
+}
+
+int main(void) {
+    srand((unsigned)time(NULL));
+
+    // prepare 100 unique random elements
+    const int N = 100;
+    int arr[N];
+    gen_unique_randoms(arr, N, 1000); // choose unique numbers from 1..1000
+
+    BTreeNode *root = NULL;
+
+    printf("Inserting 100 random keys into B-Tree (T=%d)...\n", T);
+    for (int i = 0; i < N; ++i) {
+        root = bt_insert(root, arr[i]);
+    }
+
+    printf("\nB-Tree structure after inserts:\n");
+    bt_print(root, 0);
+
+    // Demonstrate range aggregates
+    printf("\nRange aggregate demo:\n");
+    int lo = 100, hi = 500, mn, mx, median;
+    printf("Keys in [%d, %d]: count=%ld sum=%lld\n", lo, hi,
+           bt_range_count(root, lo, hi), bt_range_sum(root, lo, hi));
+    if (bt_range_min(root, lo, hi, &mn) && bt_range_max(root, lo, hi, &mx))
+        printf("Smallest=%d largest=%d\n", mn, mx);
+    if (bt_select(root, N / 2, &median))
+        printf("Median key=%d (rank %ld)\n", median, bt_rank(root, median));
+
+    // Demonstrate search
+    printf("\nSearch demo:\n");
+    int to_search[5] = {arr[0], arr[10], arr[20], 9999, arr[99]}; // include a not-present value 9999
+    for (int i = 0; i < 5; ++i) {
+        int k = to_search[i];
+        printf("Searching %d -> %s\n", k, bt_search(root, k) ? "FOUND" : "NOT FOUND");
+    }
+
+    // A miss filter answers absent keys such as 9999 without a descent
+    bt_filter filter;
+    bt_filter_init(&filter, N, BT_FILTER_COUNTERS_PER_KEY, BT_FILTER_HASHES);
+    bt_filter_rebuild(&filter, root);
+    int filter_hits = 0;
+    for (int k = 1001; k <= 2000; ++k) filter_hits += bt_filter_search(&filter, root, k);
+    printf("Filtered lookups of 1001..2000: %d found, %ld skipped the tree, fp rate %.3f\n",
+           filter_hits, filter.skipped, bt_filter_fp_rate(&filter));
+    bt_filter_free(&filter);
+
+    // Repeated lookups of a few hot keys are answered from the cache
+    bt_cache cache;
+    bt_cache_init(&cache, BT_CACHE_SLOTS);
+    for (int round = 0; round < 100; ++round)
+        for (int i = 0; i < 5; ++i) bt_cache_search(&cache, root, to_search[i]);
+    printf("Hot-key cache: %ld hits, %ld misses, hit rate %.2f\n",
+           cache.hits, cache.misses, bt_cache_hit_rate(&cache));
+    bt_cache_free(&cache);
+
+    // The same keys behind a radix directory sized from the keys themselves
+    bt_dir dir;
+    bt_dir_init(&dir, arr, N, N);
+    for (int i = 0; i < N; ++i) bt_dir_insert(&dir, arr[i]);
+    printf("Radix directory (%d slots): keys in [%d, %d] count=%ld sum=%lld, search %d -> %s\n",
+           1 << dir.bits, lo, hi, bt_dir_range_count(&dir, lo, hi), bt_dir_range_sum(&dir, lo, hi),
+           arr[5], bt_dir_search(&dir, arr[5]) ? "FOUND" : "NOT FOUND");
+    long bitmaps;
+    size_t dir_bytes = bt_dir_bytes(&dir, &bitmaps);
+    printf("Dense slots as bitmaps: %ld of %d, %zu bytes for %d keys\n", bitmaps, 1 << dir.bits, dir_bytes, N);
+    bt_dir_free(&dir);
+
+    // Nearby keys through a finger: each lookup resumes from the previous path
+    bt_finger finger;
+    bt_finger_init(&finger);
+    int finger_hits = 0;
+    for (int k = 300; k < 340; ++k) finger_hits += bt_finger_search(&finger, root, k);
+    printf("Finger scan of 300..339 -> %d keys found\n", finger_hits);
+
+    // The same lookups against a frozen read-only copy
+    bt_frozen *frozen = bt_freeze(root);
+    printf("Frozen copy (%ld keys):", frozen->n);
+    for (int i = 0; i < 5; ++i)
+        printf(" %d->%s", to_search[i], bt_frozen_search(frozen, to_search[i]) ? "FOUND" : "NOT FOUND");
+    printf("\n");
+    bt_frozen_free(frozen);
+
+    // Demonstrate deletions: remove 10 keys (first 10 inserted)
+    printf("\nDeleting 10 keys (first 10 inserted):\n");
+    for (int i = 0; i < 10; ++i) {
+        int key = arr[i];
+        printf("Deleting %d\n", key);
+        root = bt_remove(root, key);
+    }
+
+    // Lazy deletes: recorded as tombstones, applied to the tree in one pass
+    bt_tombs tombs;
+    bt_tombs_init(&tombs);
+    for (int i = 10; i < 20; ++i) root = bt_tomb_delete(&tombs, root, arr[i]);
+    printf("Tombstoned 10 more keys: %d pending, search %d -> %s\n", tombs.n, arr[10],
+           bt_tomb_search(&tombs, root, arr[10]) ? "FOUND" : "NOT FOUND");
+    root = bt_tomb_cleanup(&tombs, root, 0);
+
+    // Expire a whole key range at once
+    long expired = bt_range_count(root, 600, 799);
+    root = bt_remove_range(root, 600, 799);
+    printf("Removed keys in [600, 799]: %ld keys, %ld left there\n", expired, bt_range_count(root, 600, 799));
+
+    printf("\nB-Tree structure after deletions:\n");
+    bt_print(root, 0);
+
+    bt_health health;
+    bt_health_collect(root, &health);
+    printf("\nTree health: ");
+    bt_health_json(&health, stdout);
+
+    root = bt_compact(root, BT_LAYOUT_VEB);
+    printf("Compacted %ld nodes into one block (van Emde Boas order)\n", health.nodes);
+    printf("Search %d after compaction -> %s\n", arr[50], bt_search(root, arr[50]) ? "FOUND" : "NOT FOUND");
+
+#ifdef BT_STATS
+    printf("\nOperation statistics:\n");
+    bt_stats_print(stdout);
+#endif
+
+    bt_free(root);
+
+    // Monotonic keys take the append path and its lopsided splits
+    BTreeNode *log = NULL;
+    for (int i = 1; i <= 1000; ++i) log = bt_insert(log, i);
+    bt_health_collect(log, &health);
+    printf("\nAfter appending 1..1000: nodes=%ld avg_fill=%.2f height=%d\n",
+           health.nodes, bt_health_fill(&health), health.height);
+    bt_free(log);
+
+    // The same 100 keys bulk-built on a thread pool, no insert per key
+    int copy[N];
+    memcpy(copy, arr, sizeof(copy));
+    wp_pool *pool = wp_create(0);
+    BTreeNode *built = bt_build(copy, N, pool);
+    bt_health_collect(built, &health);
+    printf("Bulk-built %ld keys: nodes=%ld avg_fill=%.2f height=%d\n",
+           bt_size(built), health.nodes, bt_health_fill(&health), health.height);
+
+    // Parallel scan of [lo, hi]: the even keys' aggregates, then all keys copied out
+    bt_scan_result scan;
+    bt_scan_range(built, lo, hi, is_even, NULL, NULL, &scan, pool);
+    printf("Even keys in [%d, %d]: count=%ld sum=%lld", lo, hi, scan.count, scan.sum);
+    if (scan.count) printf(" min=%d max=%d", scan.min, scan.max);
+    long collected = bt_range_collect(built, lo, hi, copy, pool);
+    printf("; all keys there:");
+    for (long i = 0; i < collected && i < 8; ++i) printf(" %d", copy[i]);
+    printf("%s\n", collected > 8 ? " ..." : "");
+    wp_destroy(pool);
+    bt_free(built);
 
-    // free tree would be nice; skipping for brevity (program ends)
+    // Event counts: many repeats of a few keys (one entry per key with -DBT_MULTISET)
+    BTreeNode *events = NULL;
+    for (int i = 0; i < 10000; ++i) events = bt_insert(events, arr[i % 20]);
+    for (int i = 0; i < 20; ++i) events = bt_remove(events, arr[0]);
+    bt_health_collect(events, &health);
+    printf("Events: %ld recorded, %ld of key %d, %ld nodes\n",
+           bt_size(events), bt_range_count(events, arr[0], arr[0]), arr[0], health.nodes);
+    bt_free(events);
     return 0;
 }
+#endif
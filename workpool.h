@@ -0,0 +1,227 @@
+// Small work-stealing thread pool used for fork-join style recursion.
+// Header only: include it from the program that needs it and link with -pthread.
+//
+// Usage pattern (fork-join):
+//     wp_task t;
+//     wp_spawn(pool, &t, left_half, &left_args); // may run on another core
+//     right_half(&right_args);                    // run the other half inline
+//     wp_sync(pool, &t);                          // help with other work until t is done
+//
+// Every worker owns a deque. A thread pushes and pops at the bottom of its own
+// deque and steals from the top of a random victim when it runs dry. Threads
+// that are not pool workers (e.g. main) use an extra deque of their own. A worker
+// that finds nothing to do for a while sleeps on a condition variable until
+// wp_spawn queues a task or wp_destroy stops the pool, so an idle pool costs no CPU.
+
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#define WP_DEQUE_CAP 4096  // max pending tasks per deque; spawn runs inline when full
+
+typedef struct wp_task {
+    void (*fn)(void *);
+    void *arg;
+    atomic_int done;
+} wp_task;
+
+typedef struct wp_deque {
+    pthread_mutex_t lock;
+    wp_task *items[WP_DEQUE_CAP];
+    int top;    // steal end
+    int bottom; // owner end
+} wp_deque;
+
+typedef struct wp_pool {
+    int nthreads;
+    pthread_t *threads;
+    wp_deque *deques;  // nthreads worker deques + 1 for outside threads
+    atomic_int pending; // tasks pushed but not yet taken
+    atomic_bool stop;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t wake;    // signalled when work arrives or the pool stops
+    atomic_int sleepers;    // workers waiting on wake
+} wp_pool;
+
+static __thread int wp_self = -1; // deque index of the calling thread
+
+static inline void wp_deque_push(wp_deque *d, wp_task *t, bool *ok) {
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom - d->top < WP_DEQUE_CAP) {
+        if (d->bottom == WP_DEQUE_CAP) { // compact to the front
+            int n = d->bottom - d->top;
+            for (int i = 0; i < n; ++i) d->items[i] = d->items[d->top + i];
+            d->top = 0;
+            d->bottom = n;
+        }
+        d->items[d->bottom++] = t;
+        *ok = true;
+    } else {
+        *ok = false;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+static inline wp_task *wp_deque_pop(wp_deque *d) {
+    wp_task *t = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) t = d->items[--d->bottom];
+    pthread_mutex_unlock(&d->lock);
+    return t;
+}
+
+static inline wp_task *wp_deque_steal(wp_deque *d) {
+    wp_task *t = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->bottom > d->top) t = d->items[d->top++];
+    pthread_mutex_unlock(&d->lock);
+    return t;
+}
+
+static inline int wp_my_deque(wp_pool *p) {
+    return (wp_self >= 0 && wp_self < p->nthreads) ? wp_self : p->nthreads;
+}
+
+// Take one task: own deque first, then steal from the others.
+static inline wp_task *wp_find_task(wp_pool *p, unsigned *seed) {
+    int self = wp_my_deque(p);
+    wp_task *t = wp_deque_pop(&p->deques[self]);
+    if (!t && atomic_load(&p->pending) > 0) {
+        int total = p->nthreads + 1;
+        int start = (int)(rand_r(seed) % (unsigned)total);
+        for (int i = 0; i < total && !t; ++i) {
+            int v = (start + i) % total;
+            if (v != self) t = wp_deque_steal(&p->deques[v]);
+        }
+    }
+    if (t) atomic_fetch_sub(&p->pending, 1);
+    return t;
+}
+
+static inline void wp_run_task(wp_task *t) {
+    t->fn(t->arg);
+    atomic_store_explicit(&t->done, 1, memory_order_release);
+}
+
+typedef struct { wp_pool *pool; int id; } wp_worker_arg;
+
+static void *wp_worker(void *argp) {
+    wp_worker_arg *wa = (wp_worker_arg *)argp;
+    wp_pool *p = wa->pool;
+    wp_self = wa->id;
+    unsigned seed = (unsigned)wa->id * 2654435761u + 1;
+    free(wa);
+    int idle = 0;
+    while (!atomic_load(&p->stop)) {
+        wp_task *t = wp_find_task(p, &seed);
+        if (t) {
+            wp_run_task(t);
+            idle = 0;
+        } else if (++idle < 64) {
+            sched_yield();
+        } else {
+            // Announce the sleep before looking at pending: wp_spawn bumps pending
+            // before it looks at sleepers, so one of the two sees the other.
+            pthread_mutex_lock(&p->idle_lock);
+            atomic_fetch_add(&p->sleepers, 1);
+            while (atomic_load(&p->pending) == 0 && !atomic_load(&p->stop))
+                pthread_cond_wait(&p->wake, &p->idle_lock);
+            atomic_fetch_sub(&p->sleepers, 1);
+            pthread_mutex_unlock(&p->idle_lock);
+            idle = 0;
+        }
+    }
+    return NULL;
+}
+
+// Create a pool with nthreads workers (nthreads <= 0 => one per online CPU).
+static inline wp_pool *wp_create(int nthreads) {
+    if (nthreads <= 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = n > 0 ? (int)n : 1;
+    }
+    wp_pool *p = (wp_pool *)malloc(sizeof(wp_pool));
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    p->nthreads = nthreads;
+    p->threads = (pthread_t *)malloc(sizeof(pthread_t) * nthreads);
+    p->deques = (wp_deque *)malloc(sizeof(wp_deque) * (nthreads + 1));
+    if (!p->threads || !p->deques) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    atomic_init(&p->pending, 0);
+    atomic_init(&p->stop, false);
+    atomic_init(&p->sleepers, 0);
+    pthread_mutex_init(&p->idle_lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    for (int i = 0; i <= nthreads; ++i) {
+        pthread_mutex_init(&p->deques[i].lock, NULL);
+        p->deques[i].top = p->deques[i].bottom = 0;
+    }
+    for (int i = 0; i < nthreads; ++i) {
+        wp_worker_arg *wa = (wp_worker_arg *)malloc(sizeof(wp_worker_arg));
+        wa->pool = p;
+        wa->id = i;
+        pthread_create(&p->threads[i], NULL, wp_worker, wa);
+    }
+    return p;
+}
+
+static inline void wp_destroy(wp_pool *p) {
+    if (!p) return;
+    atomic_store(&p->stop, true);
+    pthread_mutex_lock(&p->idle_lock);
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->idle_lock);
+    for (int i = 0; i < p->nthreads; ++i) pthread_join(p->threads[i], NULL);
+    for (int i = 0; i <= p->nthreads; ++i) pthread_mutex_destroy(&p->deques[i].lock);
+    pthread_mutex_destroy(&p->idle_lock);
+    pthread_cond_destroy(&p->wake);
+    free(p->threads);
+    free(p->deques);
+    free(p);
+}
+
+// Make fn(arg) available to other threads. With no pool it simply runs now.
+static inline void wp_spawn(wp_pool *p, wp_task *t, void (*fn)(void *), void *arg) {
+    t->fn = fn;
+    t->arg = arg;
+    atomic_init(&t->done, 0);
+    if (!p) {
+        wp_run_task(t);
+        return;
+    }
+    bool ok;
+    atomic_fetch_add(&p->pending, 1);
+    wp_deque_push(&p->deques[wp_my_deque(p)], t, &ok);
+    if (!ok) {
+        atomic_fetch_sub(&p->pending, 1);
+        wp_run_task(t);
+    } else if (atomic_load(&p->sleepers) > 0) {
+        pthread_mutex_lock(&p->idle_lock);
+        pthread_cond_signal(&p->wake);
+        pthread_mutex_unlock(&p->idle_lock);
+    }
+}
+
+// Wait for t, running other queued tasks (most likely t itself) meanwhile.
+static inline void wp_sync(wp_pool *p, wp_task *t) {
+    unsigned seed = (unsigned)(size_t)t;
+    while (!atomic_load_explicit(&t->done, memory_order_acquire)) {
+        wp_task *other = p ? wp_find_task(p, &seed) : NULL;
+        if (other) wp_run_task(other);
+        else sched_yield();
+    }
+}
+
+#endif // WORKPOOL_H